@@ -1,7 +1,8 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
-// cached copies of disk block contents.  Caching disk blocks
+// The buffer cache is a hash table of buf structures holding
+// cached copies of disk block contents, with a separate list
+// ordering them for eviction.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
 //
@@ -12,6 +13,21 @@
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+//
+// Eviction is LRU, or by default 2Q, which keeps one
+// sequential pass over a large file from flushing out the
+// blocks everyone else uses: a block enters on a probation
+// list (a1) and moves to the main list (am) only if it is
+// wanted again soon after leaving a1. Metadata blocks go
+// straight to am.
+//
+// The cache grows a page of buffers at a time while free
+// memory is plentiful, and kalloc() calls breclaim() to give
+// idle pages back when it runs low.
+//
+// breadahead() and bawrite() start a transfer without waiting
+// for it; the disk interrupt releases the buffer when it is
+// done, so many requests can be outstanding at once.
 
 
 #include "types.h"
@@ -22,34 +38,290 @@
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "blkstat.h"
+#include "sysctl.h"
+
+#define NBUCKET 509              // hash buckets (prime)
+#define BPP     (PGSIZE/BSIZE)   // bufs per page of data
+#define NPAGE   ((NBUFMAX+BPP-1)/BPP)
+#define NGHOST  (NBUFMAX/2)      // blocks remembered after leaving a1
+
+// A hash chain of cached blocks, through hnext.
+// The lock protects the chain, the refcnt of its bufs,
+// and the hit counter.
+struct bucket {
+  struct spinlock lock;
+  struct buf *head;
+  uint64 hits;
+};
 
 struct {
+  // Protects the eviction list and the counters below.
+  // Also held while a buffer is recycled for a new block,
+  // which serializes cache misses but not hits.
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct buf buf[NBUFMAX];
+  char *page[NPAGE];  // data of buf[i*BPP..(i+1)*BPP-1], or 0
+  int nbuf;           // bufs that have data pages
+  int max;            // most bufs to grow to
+  int policy;         // BCACHE_LRU or BCACHE_2Q
+
+  // Every buffer with a data page is on one of two lists,
+  // through prev/next. am is sorted by how recently the
+  // buffer was released, a1 by when it got its block;
+  // next is most recent, prev is least. Under LRU,
+  // everything is on am, and a1 only holds leftovers.
+  struct buf a1;
+  struct buf am;
+  int na1;            // bufs on a1
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+  // Blocks recently evicted from a1, as (dev<<32)|blockno,
+  // in a ring; the last nbuf/2 count. 0 is an empty slot.
+  uint64 ghost[NGHOST];
+  uint ghosthead;
+
+  int reading; // breadahead()s that have not finished
+  int writing; // bawrite()s that have not finished
+  // bawrite()s are counted by generation, which bflush()
+  // advances, so that it waits only for those started before
+  // it and a steady stream of new ones cannot hold it up.
+  uint wgen;
+  int wpending[2];
+
+  uint64 misses;     // blocks brought into the cache
+  uint64 evictions;  // cached blocks recycled for others
+  uint64 grows;      // pages added
+  uint64 shrinks;    // pages given back to kalloc()
+
+  // Headers for bwriteto(), never in the cache.
+  struct sleeplock shadowlock;
+  struct buf shadow[MAXSEG];
+
+  struct bucket bucket[NBUCKET];
 } bcache;
 
+// Put b on list l, at the most recently used end if mru,
+// otherwise at the least. Caller must hold bcache.lock.
+static void
+binsert(struct buf *l, struct buf *b, int mru)
+{
+  if(mru){
+    b->prev = l;
+    b->next = l->next;
+  } else {
+    b->prev = l->prev;
+    b->next = l;
+  }
+  b->prev->next = b;
+  b->next->prev = b;
+  b->list = l;
+  if(l == &bcache.a1)
+    bcache.na1++;
+}
+
+// Take b off its list. Caller must hold bcache.lock.
+static void
+bremove(struct buf *b)
+{
+  b->next->prev = b->prev;
+  b->prev->next = b->next;
+  if(b->list == &bcache.a1)
+    bcache.na1--;
+  b->list = 0;
+}
+
+// Add a page of empty buffers to the cold end of a1.
+// Returns -1 if the cache is at its largest or there
+// is no memory. Caller must hold bcache.lock.
+static int
+bgrow(void)
+{
+  struct buf *b;
+  char *pa;
+  int i, j;
+
+  if(bcache.nbuf + BPP > bcache.max)
+    return -1;
+  for(i = 0; i < NPAGE; i++)
+    if(bcache.page[i] == 0)
+      break;
+  if(i == NPAGE || (pa = kalloc()) == 0)
+    return -1;
+  bcache.page[i] = pa;
+  for(j = 0; j < BPP; j++){
+    b = &bcache.buf[i*BPP + j];
+    b->data = (uchar*)pa + j*BSIZE;
+    b->valid = 0;
+    b->refcnt = 0;
+    b->hnext = 0;
+    binsert(&bcache.a1, b, 0);
+  }
+  bcache.nbuf += BPP;
+  bcache.grows++;
+  return 0;
+}
+
 void
 binit(void)
 {
   struct buf *b;
+  struct bucket *bk;
 
   initlock(&bcache.lock, "bcache");
-
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++)
+    initlock(&bk->lock, "bcache.bucket");
+  for(b = bcache.buf; b < bcache.buf+NBUFMAX; b++)
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+  initsleeplock(&bcache.shadowlock, "shadow");
+
+  // Create linked lists of buffers
+  bcache.a1.prev = bcache.a1.next = &bcache.a1;
+  bcache.am.prev = bcache.am.next = &bcache.am;
+  bcache.max = NBUFMAX;
+  bcache.policy = BCACHE_2Q;
+  acquire(&bcache.lock);
+  while(bcache.nbuf < NBUFMIN)
+    if(bgrow() < 0)
+      panic("binit");
+  release(&bcache.lock);
+}
+
+static struct bucket*
+bhash(uint dev, uint blockno)
+{
+  return &bcache.bucket[(dev * 31 + blockno) % NBUCKET];
+}
+
+// Look for the block in its hash chain.
+// Caller must hold bk->lock.
+static struct buf*
+bcached(struct bucket *bk, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bk->head; b; b = b->hnext)
+    if(b->dev == dev && b->blockno == blockno)
+      return b;
+  return 0;
+}
+
+// If b is unused, take it out of its hash chain, forgetting
+// its block, and return 0; otherwise return -1.
+// Caller must hold bcache.lock.
+static int
+bunhash(struct buf *b)
+{
+  struct buf **pb;
+  struct bucket *bk;
+
+  if(b->refcnt != 0)
+    return -1;  // a hint; checked again under the bucket lock
+  bk = bhash(b->dev, b->blockno);
+  acquire(&bk->lock);
+  if(b->refcnt != 0){
+    release(&bk->lock);
+    return -1;
+  }
+  for(pb = &bk->head; *pb; pb = &(*pb)->hnext){
+    if(*pb == b){
+      *pb = b->hnext;
+      if(b->valid){
+        bcache.evictions++;
+        if(b->list == &bcache.a1){
+          bcache.ghost[bcache.ghosthead++ % NGHOST] =
+            (uint64)b->dev << 32 | b->blockno;
+        }
+      }
+      break;
+    }
   }
+  b->hnext = 0;
+  b->valid = 0;
+  release(&bk->lock);
+  return 0;
+}
+
+// Was the block evicted from a1 recently? If so, forget
+// that it was. Caller must hold bcache.lock.
+static int
+bghost(uint dev, uint blockno)
+{
+  uint64 key = (uint64)dev << 32 | blockno;
+  uint i, n;
+
+  n = bcache.nbuf / 2;
+  if(n > bcache.ghosthead)
+    n = bcache.ghosthead;
+  for(i = 1; i <= n; i++){
+    if(bcache.ghost[(bcache.ghosthead - i) % NGHOST] == key){
+      bcache.ghost[(bcache.ghosthead - i) % NGHOST] = 0;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Unhash and return the least recently used unused
+// buffer on list l, or 0 if there is none.
+// Caller must hold bcache.lock.
+static struct buf*
+bcold(struct buf *l)
+{
+  struct buf *b;
+
+  for(b = l->prev; b != l; b = b->prev)
+    if(bunhash(b) == 0)
+      return b;
+  return 0;
+}
+
+// Take the least recently used unused buffer out of its
+// hash chain and return it, or return 0 if every buffer
+// is in use. Grows the cache instead while memory is
+// plentiful. Under 2Q, evicts from a1 while it holds more
+// than a quarter of the cache. Caller must hold bcache.lock.
+static struct buf*
+brecycle(void)
+{
+  struct buf *b;
+
+  if(kfreecount() > NBUFRESERVE)
+    bgrow();
+  if(bcache.policy == BCACHE_LRU || bcache.na1 > bcache.nbuf/4){
+    if((b = bcold(&bcache.a1)) == 0)
+      b = bcold(&bcache.am);
+  } else {
+    if((b = bcold(&bcache.am)) == 0)
+      b = bcold(&bcache.a1);
+  }
+  return b;
+}
+
+// Give unhashed buffer b to the indicated block, with one
+// reference and no valid data. Caller must hold bcache.lock.
+static void
+bassign(struct buf *b, uint dev, uint blockno)
+{
+  struct bucket *bk = bhash(dev, blockno);
+
+  acquire(&bk->lock);
+  b->dev = dev;
+  b->blockno = blockno;
+  b->valid = 0;
+  b->refcnt = 1;
+  b->hnext = bk->head;
+  bk->head = b;
+  release(&bk->lock);
+  b->meta = 0;
+  bcache.misses++;
+
+  // Under 2Q, a block goes on probation unless it was
+  // evicted from probation only recently.
+  bremove(b);
+  if(bcache.policy == BCACHE_2Q && !bghost(dev, blockno))
+    binsert(&bcache.a1, b, 1);
+  else
+    binsert(&bcache.am, b, 1);
 }
 
 // Look through buffer cache for block on device dev.
@@ -58,34 +330,59 @@ binit(void)
 static struct buf*
 bget(uint dev, uint blockno)
 {
+  struct bucket *bk = bhash(dev, blockno);
   struct buf *b;
 
-  acquire(&bcache.lock);
-
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
+  acquire(&bk->lock);
+  if((b = bcached(bk, dev, blockno)) != 0){
+    b->refcnt++;
+    bk->hits++;
+    release(&bk->lock);
+    acquiresleep(&b->lock);
+    return b;
+  }
+  release(&bk->lock);
+
+  acquire(&bcache.lock);
+  for(;;){
+    // Check again: another miss may have brought the block
+    // in since we looked. Holding bcache.lock, no one else
+    // can add it now.
+    acquire(&bk->lock);
+    if((b = bcached(bk, dev, blockno)) != 0){
       b->refcnt++;
+      bk->hits++;
+      release(&bk->lock);
       release(&bcache.lock);
       acquiresleep(&b->lock);
       return b;
     }
-  }
+    release(&bk->lock);
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
+    // Not cached.
+    // Recycle the least recently used (LRU) unused buffer.
+    if((b = brecycle()) != 0){
+      bassign(b, dev, blockno);
       release(&bcache.lock);
       acquiresleep(&b->lock);
       return b;
     }
+
+    // Every buffer is busy. Async transfers will
+    // release theirs when they finish, once dispatched.
+    if(bcache.reading + bcache.writing == 0)
+      panic("bget: no buffers");
+    release(&bcache.lock);
+    if(blk_poll()){
+      acquire(&bcache.lock);
+      continue;
+    }
+    blk_kick();
+    acquire(&bcache.lock);
+    if(bcache.reading + bcache.writing > 0)
+      sleep(&bcache, &bcache.lock);
   }
-  panic("bget: no buffers");
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -96,23 +393,247 @@ bread(uint dev, uint blockno)
 
   b = bget(dev, blockno);
   if(!b->valid) {
-    virtio_disk_rw(b, 0);
+    blk_rw(b, 0);
     b->valid = 1;
   }
   return b;
 }
 
+// Return a locked buf for a block that the caller is about
+// to overwrite completely, without reading it from disk.
+struct buf*
+bgrab(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  b->valid = 1;
+  return b;
+}
+
+// Drop a reference to b. If it was the last,
+// move b to the most recently used end of its list.
+static void
+bunref(struct buf *b)
+{
+  struct bucket *bk = bhash(b->dev, b->blockno);
+
+  acquire(&bk->lock);
+  if(b->refcnt > 1){
+    b->refcnt--;
+    release(&bk->lock);
+    return;
+  }
+  release(&bk->lock);
+
+  // The last reference. Keep it until b has been moved, so
+  // that bfreepage() cannot take b's page away meanwhile;
+  // holding bcache.lock across both keeps it out.
+  acquire(&bcache.lock);
+  // a1 is first in first out, so under 2Q b stays
+  // put there, unless it is metadata.
+  if(b->list == &bcache.am || b->meta || bcache.policy == BCACHE_LRU){
+    bremove(b);
+    binsert(&bcache.am, b, 1);
+  }
+  acquire(&bk->lock);
+  b->refcnt--;
+  release(&bk->lock);
+  release(&bcache.lock);
+}
+
+// Disk interrupt: a breadahead() finished.
+static void
+breadahead_done(struct buf *b)
+{
+  b->valid = 1;
+  releasesleep(&b->lock);
+  bunref(b);
+  acquire(&bcache.lock);
+  bcache.reading--;
+  wakeup(&bcache);
+  release(&bcache.lock);
+}
+
+// Claim and lock a buffer for an uncached block, for
+// breadahead(). Returns 0 if the block is already cached
+// or every buffer is in use.
+static struct buf*
+bclaim(uint dev, uint blockno)
+{
+  struct bucket *bk = bhash(dev, blockno);
+  struct buf *b;
+  int used;
+
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  b = bcached(bk, dev, blockno);
+  release(&bk->lock);
+  if(b || (b = brecycle()) == 0){
+    release(&bcache.lock);
+    return 0;
+  }
+  bassign(b, dev, blockno);
+  bcache.reading++;
+  release(&bcache.lock);
+  acquiresleep(&b->lock);
+
+  // A bget() may have found b before we locked it, and read
+  // or even modified it; or it is waiting to. Leave b to it.
+  acquire(&bk->lock);
+  used = b->valid || b->refcnt > 1;
+  release(&bk->lock);
+  if(used){
+    releasesleep(&b->lock);
+    bunref(b);
+    acquire(&bcache.lock);
+    bcache.reading--;
+    wakeup(&bcache);
+    release(&bcache.lock);
+    return 0;
+  }
+  b->iodone = breadahead_done;
+  return b;
+}
+
+// Start reading the n blocks from blockno into the cache,
+// skipping those already there, without waiting. The block
+// layer merges runs of missing blocks into single requests.
+// A later bread() of a block waits for its read to finish.
+// Gives up quietly on blocks for which no buffer is free.
+void
+breadahead(uint dev, uint blockno, int n)
+{
+  struct buf *b;
+
+  blk_plug();
+  for(; n > 0; n--, blockno++){
+    if((b = bclaim(dev, blockno)) != 0)
+      blk_submit(b, 0);
+  }
+  blk_unplug();
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
 {
   if(!holdingsleep(&b->lock))
     panic("bwrite");
-  virtio_disk_rw(b, 1);
+  blk_rw(b, 1);
+}
+
+// Write the contents of each locked buf bs[i] to block
+// blocknos[i] instead of its own, and wait for the writes.
+// The cached copy of blocknos[i], which may be newer,
+// is left alone. n must be at most MAXSEG.
+void
+bwriteto(struct buf **bs, uint *blocknos, int n)
+{
+  struct buf *s;
+  int i;
+
+  if(n > MAXSEG)
+    panic("bwriteto");
+  acquiresleep(&bcache.shadowlock);
+  blk_plug();
+  for(i = 0; i < n; i++){
+    s = &bcache.shadow[i];
+    s->dev = bs[i]->dev;
+    s->blockno = blocknos[i];
+    s->data = bs[i]->data;
+    s->iodone = 0;
+    blk_submit(s, 1);
+  }
+  blk_unplug();
+  for(i = 0; i < n; i++)
+    blk_wait(&bcache.shadow[i]);
+  releasesleep(&bcache.shadowlock);
+}
+
+// Disk interrupt: a bawrite() finished.
+static void
+bawrite_done(struct buf *b)
+{
+  int wgen = b->wgen;  // b may be locked and bawrite() again at once
+
+  releasesleep(&b->lock);
+  bunref(b);
+  acquire(&bcache.lock);
+  bcache.writing--;
+  if(--bcache.wpending[wgen] == 0)
+    wakeup(&bcache.wpending);
+  wakeup(&bcache);
+  release(&bcache.lock);
+}
+
+// Start writing b's contents to disk and release b, as
+// brelse() would, once the write finishes. Must be locked.
+// The caller must not use b afterwards.
+void
+bawrite(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bawrite");
+  acquire(&bcache.lock);
+  bcache.writing++;
+  b->wgen = bcache.wgen & 1;
+  bcache.wpending[b->wgen]++;
+  release(&bcache.lock);
+  b->iodone = bawrite_done;
+  blk_submit(b, 1);
+}
+
+// bawrite() each of the n locked bufs in bs[] as one batch,
+// which the block layer can merge and sort.
+void
+bawritev(struct buf **bs, int n)
+{
+  int i;
+
+  blk_plug();
+  for(i = 0; i < n; i++)
+    bawrite(bs[i]);
+  blk_unplug();
+}
+
+// Have the bawrite()s of generation g all finished? Starts
+// generation g+1 as soon as the one before g has, so that
+// bawrite()s from then on do not count. Caller holds bcache.lock.
+static int
+bflushed(uint g)
+{
+  if(bcache.wgen == g && bcache.wpending[(g+1) & 1] == 0)
+    bcache.wgen = g+1;
+  if(bcache.wgen == g)
+    return 0;  // generation g-1 is still being written
+  if(bcache.wgen == g+1)
+    return bcache.wpending[g & 1] == 0;
+  return 1;    // a later bflush() has seen generation g finish
+}
+
+// Wait until every bawrite() started before the call has finished.
+void
+bflush(void)
+{
+  uint g;
+  int polled;
+
+  acquire(&bcache.lock);
+  g = bcache.wgen;
+  while(!bflushed(g)){
+    release(&bcache.lock);
+    if(!(polled = blk_poll()))
+      blk_kick();
+    acquire(&bcache.lock);
+    if(!polled && !bflushed(g))
+      sleep(&bcache.wpending, &bcache.lock);
+  }
+  release(&bcache.lock);
 }
 
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// Move to the most recently used end of its list.
 void
 brelse(struct buf *b)
 {
@@ -120,33 +641,175 @@ brelse(struct buf *b)
     panic("brelse");
 
   releasesleep(&b->lock);
+  bunref(b);
+}
+
+void
+bpin(struct buf *b) {
+  struct bucket *bk = bhash(b->dev, b->blockno);
+
+  acquire(&bk->lock);
+  b->refcnt++;
+  release(&bk->lock);
+}
+
+void
+bunpin(struct buf *b) {
+  bunref(b);
+}
+
+// Mark locked buf b as holding file system metadata,
+// which 2Q keeps ahead of file contents.
+void
+bmeta(struct buf *b)
+{
+  b->meta = 1;
+}
+
+// Free the page holding b's data if all of its buffers are
+// idle, forgetting their blocks. Returns -1 if some are in
+// use; if one turns out to be only after it has been
+// unhashed, the rest stay as empty bufs.
+// Caller must hold bcache.lock.
+static int
+bfreepage(struct buf *b)
+{
+  struct buf *p;
+  int i, pg;
+
+  pg = (b - bcache.buf) / BPP;
+  p = &bcache.buf[pg*BPP];
+  for(i = 0; i < BPP; i++)
+    if(p[i].refcnt != 0)
+      return -1;
+  for(i = 0; i < BPP; i++)
+    if(bunhash(&p[i]) < 0)
+      return -1;
+  for(i = 0; i < BPP; i++){
+    bremove(&p[i]);
+    p[i].data = 0;
+  }
+  kfree(bcache.page[pg]);
+  bcache.page[pg] = 0;
+  bcache.nbuf -= BPP;
+  bcache.shrinks++;
+  return 0;
+}
+
+// Free up to n pages of idle buffers, least recently used
+// first, a1 before am, keeping at least min buffers.
+// Returns the number of pages freed.
+// Caller must hold bcache.lock.
+static int
+bshrink(int n, int min)
+{
+  struct buf *l, *b;
+  int freed;
+
+  freed = 0;
+again:
+  for(l = &bcache.a1; ; l = &bcache.am){
+    for(b = l->prev; b != l; b = b->prev){
+      if(freed >= n || bcache.nbuf - BPP < min)
+        return freed;
+      if(bfreepage(b) == 0){
+        freed++;
+        goto again;  // b is gone, and perhaps b->prev too
+      }
+    }
+    if(l == &bcache.am)
+      return freed;
+  }
+}
+
+// Memory is short: give up to n pages back to kalloc(),
+// without shrinking below NBUFMIN buffers. Returns the
+// number of pages freed. Called by kalloc(); never sleeps.
+int
+breclaim(int n)
+{
+  int freed;
 
   acquire(&bcache.lock);
-  b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
+  freed = bshrink(n, NBUFMIN);
   release(&bcache.lock);
+  return freed;
 }
 
+// Forget every cached block that is not in use, so that
+// the next use of each reads it from disk. Only blocks in
+// use can differ from their copies on disk.
 void
-bpin(struct buf *b) {
+bdrop(void)
+{
+  struct buf *l, *b;
+
   acquire(&bcache.lock);
-  b->refcnt++;
+  for(l = &bcache.a1; ; l = &bcache.am){
+    for(b = l->next; b != l; b = b->next)
+      bunhash(b);
+    if(l == &bcache.am)
+      break;
+  }
+  release(&bcache.lock);
+}
+
+// Set the most buffers the cache may hold, shrinking it
+// now if need be, unless n is -1. Returns the old limit.
+int
+bsetmax(int n)
+{
+  int old;
+
+  acquire(&bcache.lock);
+  old = bcache.max;
+  if(n >= 0){
+    if(n < NBUFMIN)
+      n = NBUFMIN;
+    if(n > NBUFMAX)
+      n = NBUFMAX;
+    bcache.max = (n + BPP-1) / BPP * BPP;
+    bshrink(NPAGE, bcache.max);
+  }
   release(&bcache.lock);
+  return old;
 }
 
+// Set the eviction policy to BCACHE_LRU or BCACHE_2Q,
+// unless p is -1. Returns the old policy.
+int
+bsetpolicy(int p)
+{
+  int old;
+
+  if(p > BCACHE_2Q)
+    return -1;
+  acquire(&bcache.lock);
+  old = bcache.policy;
+  if(p >= 0)
+    bcache.policy = p;
+  release(&bcache.lock);
+  return old;
+}
+
+// Fill in the buffer cache's part of *st.
 void
-bunpin(struct buf *b) {
+bstat(struct blkstat *st)
+{
+  struct bucket *bk;
+
+  st->hits = 0;
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++){
+    acquire(&bk->lock);
+    st->hits += bk->hits;
+    release(&bk->lock);
+  }
   acquire(&bcache.lock);
-  b->refcnt--;
+  st->nbuf = bcache.nbuf;
+  st->misses = bcache.misses;
+  st->evictions = bcache.evictions;
+  st->grows = bcache.grows;
+  st->shrinks = bcache.shrinks;
   release(&bcache.lock);
 }
 
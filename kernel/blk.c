@@ -0,0 +1,293 @@
+// Block request queue.
+//
+// Sits between the buffer cache and the disk driver.
+// blk_submit() queues a buf for transfer. A buf for the block
+// just after (or before) a queued request, in the same
+// direction, is merged into that request, so runs of blocks
+// go to the disk as single multi-block requests.
+//
+// Queued requests are dispatched to the disk, at most DEPTH at
+// a time, in elevator order: ascending block number from where
+// the last request ended, wrapping around at the end of the disk.
+// A request that has waited past its deadline (reads have a
+// shorter one than writes) goes next regardless.
+//
+// blk_plug()/blk_unplug() hold back dispatching while a caller
+// queues a batch, so that the batch can be merged and sorted.
+// Someone waiting for a buf in blk_wait() dispatches at once,
+// and, if the disk is in polling mode, spins checking for the
+// completion rather than sleeping until an interrupt.
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "blk.h"
+#include "blkstat.h"
+
+#define NREQ 32          // requests queued or in flight
+#define DEPTH 16         // max requests at the device
+#define READ_EXPIRE 1    // ticks a read may wait to be dispatched
+#define WRITE_EXPIRE 5   // ticks a write may wait to be dispatched
+
+struct {
+  struct spinlock lock;
+  struct blkreq req[NREQ];
+  struct blkreq *free;   // unused requests
+  struct blkreq *queue;  // waiting to be dispatched, by block number
+  int plugged;           // depth of blk_plug() calls
+  uint pos;              // block after the last dispatched request
+  struct blkstat stat;
+} blk;
+
+void
+blkinit(void)
+{
+  struct blkreq *r;
+
+  initlock(&blk.lock, "blk");
+  for(r = blk.req; r < blk.req+NREQ; r++){
+    r->next = blk.free;
+    blk.free = r;
+  }
+}
+
+// Choose the next queued request to dispatch and return
+// the link that points to it. Caller must hold blk.lock
+// and the queue must not be empty.
+static struct blkreq**
+pick(void)
+{
+  struct blkreq **pr, **oldest = 0, **next = 0;
+
+  for(pr = &blk.queue; *pr; pr = &(*pr)->next){
+    if(oldest == 0 || (int)((*pr)->deadline - (*oldest)->deadline) < 0)
+      oldest = pr;
+    if(next == 0 && (*pr)->head->blockno >= blk.pos)
+      next = pr;
+  }
+  if((int)(ticks - (*oldest)->deadline) >= 0)
+    return oldest;
+  if(next == 0)
+    next = &blk.queue;  // wrap around to the lowest block
+  return next;
+}
+
+// Hand queued requests to the disk while it has room.
+// Unless force is set, do nothing while plugged.
+// Caller must hold blk.lock.
+static void
+dispatch(int force)
+{
+  struct blkreq **pr, *r;
+  int n = 0;
+
+  if(blk.plugged && !force)
+    return;
+  while(blk.queue && blk.stat.inflight < DEPTH){
+    pr = pick();
+    r = *pr;
+    *pr = r->next;
+    if(virtio_disk_submit(r) < 0){
+      // out of descriptors; a completion will call us again.
+      r->next = *pr;
+      *pr = r;
+      break;
+    }
+    blk.stat.queued--;
+    blk.stat.inflight++;
+    blk.pos = r->tail->blockno + 1;
+    n++;
+  }
+  if(n > 0)
+    virtio_disk_notify(); // once for the whole batch
+}
+
+// Queue a transfer of locked buf b to or from the disk and
+// return without waiting. When it finishes, b->iodone(b) is
+// called if set; otherwise use blk_wait().
+void
+blk_submit(struct buf *b, int write)
+{
+  struct blkreq *r, **pr;
+
+  acquire(&blk.lock);
+  b->disk = 1;
+  b->qnext = 0;
+
+  // merge with a queued request for a neighbouring block.
+  for(r = blk.queue; r; r = r->next){
+    if(r->write != write || r->nbuf == MAXSEG || r->head->dev != b->dev)
+      continue;
+    if(r->tail->blockno + 1 == b->blockno){
+      r->tail->qnext = b;
+      r->tail = b;
+      break;
+    }
+    if(b->blockno + 1 == r->head->blockno){
+      b->qnext = r->head;
+      r->head = b;
+      break;
+    }
+  }
+  if(r){
+    r->nbuf++;
+    blk.stat.merges++;
+  } else {
+    while(blk.free == 0){
+      dispatch(1);
+      sleep(&blk.free, &blk.lock);
+    }
+    r = blk.free;
+    blk.free = r->next;
+    r->head = r->tail = b;
+    r->nbuf = 1;
+    r->write = write;
+    r->deadline = ticks + (write ? WRITE_EXPIRE : READ_EXPIRE);
+    r->queued = r_time();
+    for(pr = &blk.queue; *pr && (*pr)->head->blockno < b->blockno; pr = &(*pr)->next)
+      ;
+    r->next = *pr;
+    *pr = r;
+    blk.stat.queued++;
+    if(blk.stat.queued + blk.stat.inflight > blk.stat.maxdepth)
+      blk.stat.maxdepth = blk.stat.queued + blk.stat.inflight;
+  }
+
+  dispatch(0);
+  release(&blk.lock);
+}
+
+// Wait for the transfer of b queued by blk_submit() to finish.
+void
+blk_wait(struct buf *b)
+{
+  acquire(&blk.lock);
+  while(b->disk){
+    if(virtio_disk_polling()){
+      // spin on the device instead of waiting for an interrupt.
+      release(&blk.lock);
+      blk_poll();
+      acquire(&blk.lock);
+    } else {
+      dispatch(1);
+      sleep(b, &blk.lock);
+    }
+  }
+  release(&blk.lock);
+}
+
+// In polling mode, dispatch whatever is queued and check for
+// completions, and return 1; callers waiting for I/O call this
+// in a loop instead of sleeping. Otherwise return 0.
+int
+blk_poll(void)
+{
+  if(!virtio_disk_polling())
+    return 0;
+  blk_kick();
+  virtio_disk_poll();
+  return 1;
+}
+
+// Transfer locked buf b and wait for it.
+void
+blk_rw(struct buf *b, int write)
+{
+  blk_submit(b, write);
+  blk_wait(b);
+}
+
+// Hold queued requests back until the matching blk_unplug().
+void
+blk_plug(void)
+{
+  acquire(&blk.lock);
+  blk.plugged++;
+  release(&blk.lock);
+}
+
+void
+blk_unplug(void)
+{
+  acquire(&blk.lock);
+  if(--blk.plugged == 0)
+    dispatch(0);
+  release(&blk.lock);
+}
+
+// Dispatch whatever is queued, even if plugged, e.g. because
+// the caller must wait for some queued transfer to finish.
+void
+blk_kick(void)
+{
+  acquire(&blk.lock);
+  dispatch(1);
+  release(&blk.lock);
+}
+
+// Disk interrupt: request r has finished.
+// Called without holding any locks.
+void
+blk_done(struct blkreq *r)
+{
+  struct buf *b, *next, *done = 0;
+  uint64 us;
+  int i;
+
+  acquire(&blk.lock);
+
+  blk.stat.inflight--;
+  if(r->write)
+    blk.stat.writes++;
+  else
+    blk.stat.reads++;
+  blk.stat.blocks += r->nbuf;
+  us = (r_time() - r->queued) / (CLINT_HZ / 1000000);
+  for(i = 0; i < NBLKHIST-1 && us >= (2UL << i); i++)
+    ;
+  blk.stat.hist[i]++;
+
+  for(b = r->head; b; b = next){
+    next = b->qnext;
+    b->disk = 0;
+    if(b->iodone){
+      // collect for the callback below.
+      b->qnext = done;
+      done = b;
+    } else {
+      wakeup(b);
+    }
+  }
+  r->next = blk.free;
+  blk.free = r;
+  wakeup(&blk.free);
+
+  dispatch(0);
+  release(&blk.lock);
+
+  // completion callbacks may take other locks,
+  // so run them without blk.lock.
+  while(done){
+    b = done;
+    void (*fn)(struct buf*) = b->iodone;
+    done = b->qnext;  // the callback may release b
+    b->iodone = 0;
+    fn(b);
+  }
+}
+
+// Copy out the current statistics.
+void
+blk_stat(struct blkstat *st)
+{
+  acquire(&blk.lock);
+  *st = blk.stat;
+  virtio_disk_stat(&st->notifies, &st->intrs);
+  release(&blk.lock);
+}
@@ -0,0 +1,12 @@
+// A block I/O request: one or more bufs holding consecutive
+// blocks, transferred in the same direction. blk.c builds
+// them and virtio_disk.c carries them out.
+struct blkreq {
+  struct buf *head;     // bufs in block order, linked by qnext
+  struct buf *tail;
+  int nbuf;
+  int write;
+  uint deadline;        // ticks by which it should be dispatched
+  uint64 queued;        // time CSR value when queued
+  struct blkreq *next;  // in the pending queue, or free list
+};
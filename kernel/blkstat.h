@@ -0,0 +1,23 @@
+#define NBLKHIST 16  // buckets in the latency histogram
+
+// Disk request and buffer cache statistics, returned by blkstat().
+struct blkstat {
+  uint64 reads;           // requests completed, by direction
+  uint64 writes;
+  uint64 blocks;          // blocks transferred
+  uint64 merges;          // bufs added to an already queued request
+  uint queued;            // requests waiting to be dispatched now
+  uint inflight;          // requests at the device now
+  uint maxdepth;          // most requests ever queued plus in flight
+  uint64 notifies;        // times the device was notified of new requests
+  uint64 intrs;           // completion interrupts taken
+  uint64 hist[NBLKHIST];  // hist[i]: requests that took 2^i..2^(i+1)-1 us,
+                          // from queueing to completion; the first and
+                          // last buckets also count anything beyond them
+  uint nbuf;              // bufs in the buffer cache now
+  uint64 hits;            // lookups that found their block cached
+  uint64 misses;          // blocks read or written through a new buf
+  uint64 evictions;       // cached blocks dropped to make room for others
+  uint64 grows;           // pages of bufs added to the cache
+  uint64 shrinks;         // pages given back because memory ran low
+};
@@ -1,12 +1,18 @@
 struct buf {
   int valid;   // has data been read from disk?
   int disk;    // does disk "own" buf?
+  void (*iodone)(struct buf*); // if set, called when an async transfer finishes
+  struct buf *qnext; // next buf in the same disk request
   uint dev;
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
+  int wgen;    // bawrite() generation, for bflush()
+  int meta;    // holds file system metadata?
+  struct buf *list; // which of bcache's eviction lists b is on
+  struct buf *prev; // eviction list
   struct buf *next;
-  uchar data[BSIZE];
+  struct buf *hnext; // hash chain
+  uchar *data;       // BSIZE bytes, in one of bcache's pages
 };
 
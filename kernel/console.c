@@ -21,6 +21,8 @@
 #include "riscv.h"
 #include "defs.h"
 #include "proc.h"
+#include "poll.h"
+#include "errno.h"
 
 #define BACKSPACE 0x100
 #define C(x)  ((x)-'@')  // Control-x
@@ -50,6 +52,8 @@ struct {
   uint r;  // Read index
   uint w;  // Write index
   uint e;  // Edit index
+
+  struct waitq pollq; // processes in poll()
 } cons;
 
 //
@@ -75,9 +79,11 @@ consolewrite(int user_src, uint64 src, int n)
 // copy (up to) a whole input line to dst.
 // user_dist indicates whether dst is a user
 // or kernel address.
+// if nonblock, return -EAGAIN rather than
+// wait for a line to be typed.
 //
 int
-consoleread(int user_dst, uint64 dst, int n)
+consoleread(int user_dst, uint64 dst, int n, int nonblock)
 {
   uint target;
   int c;
@@ -93,6 +99,10 @@ consoleread(int user_dst, uint64 dst, int n)
         release(&cons.lock);
         return -1;
       }
+      if(nonblock){
+        release(&cons.lock);
+        return n < target ? target - n : -EAGAIN;
+      }
       sleep(&cons.r, &cons.lock);
     }
 
@@ -170,6 +180,7 @@ consoleintr(int c)
         // has arrived.
         cons.w = cons.e;
         wakeup(&cons.r);
+        pollwakeup(&cons.pollq);
       }
     }
     break;
@@ -178,6 +189,23 @@ consoleintr(int c)
   release(&cons.lock);
 }
 
+//
+// poll() on the console: readable once a whole line
+// (or end-of-file) has arrived; always writable.
+//
+int
+consolepoll(struct pollctx *ctx)
+{
+  int r = POLLOUT;
+
+  pollwait(ctx, &cons.pollq);
+  acquire(&cons.lock);
+  if(cons.r != cons.w)
+    r |= POLLIN;
+  release(&cons.lock);
+  return r;
+}
+
 void
 consoleinit(void)
 {
@@ -189,4 +217,5 @@ consoleinit(void)
   // to consoleread and consolewrite.
   devsw[CONSOLE].read = consoleread;
   devsw[CONSOLE].write = consolewrite;
+  devsw[CONSOLE].poll = consolepoll;
 }
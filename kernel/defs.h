@@ -1,21 +1,56 @@
+struct blkreq;
+struct blkstat;
 struct buf;
 struct context;
 struct file;
 struct inode;
+struct iovec;
 struct pipe;
+struct pollctx;
+struct pollfd;
 struct proc;
+struct ra;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct waitq;
+
+// blk.c
+void            blkinit(void);
+void            blk_submit(struct buf*, int);
+void            blk_wait(struct buf*);
+void            blk_rw(struct buf*, int);
+void            blk_plug(void);
+void            blk_unplug(void);
+void            blk_kick(void);
+int             blk_poll(void);
+void            blk_done(struct blkreq*);
+void            blk_stat(struct blkstat*);
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+struct buf*     bgrab(uint, uint);
+void            breadahead(uint, uint, int);
+void            bawrite(struct buf*);
+void            bawritev(struct buf**, int);
+void            bwriteto(struct buf**, uint*, int);
+void            bflush(void);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+void            bmeta(struct buf*);
+void            bdrop(void);
+int             breclaim(int);
+int             bsetmax(int);
+int             bsetpolicy(int);
+void            bstat(struct blkstat*);
+
+// crc.c
+void            crcinit(void);
+uint            crc32c(uint, const void*, uint);
 
 // console.c
 void            consoleinit(void);
@@ -30,15 +65,20 @@ struct file*    filealloc(void);
 void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
-int             fileread(struct file*, uint64, int n);
+int             fileread(struct file*, int, uint64, int n);
+int             filereadv(struct file*, struct iovec*, int);
+int             filepread(struct file*, uint64, int, uint);
+int             filepwrite(struct file*, uint64, int, uint);
+int             filesplice(struct file*, struct file*, uint*, int);
 int             filestat(struct file*, uint64 addr);
-int             filewrite(struct file*, uint64, int n);
+int             filewrite(struct file*, int, uint64, int n);
+int             filewritev(struct file*, struct iovec*, int);
 
 // fs.c
 void            fsinit(int);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
-struct inode*   ialloc(uint, short);
+struct inode*   ialloc(uint, short, uint);
 struct inode*   idup(struct inode*);
 void            iinit();
 void            ilock(struct inode*);
@@ -50,6 +90,9 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
+int             writecost(struct inode*, uint, uint);
+uint            writemax(struct inode*, uint, int);
+void            readahead(struct inode*, struct ra*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
@@ -62,19 +105,40 @@ void            ramdiskrw(struct buf*);
 // kalloc.c
 void*           kalloc(void);
 void            kfree(void *);
+int             kfreecount(void);
 void            kinit(void);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
+void            begin_opn(int);
 void            end_op(void);
+void            log_restart(void);
+void            log_sync(void);
+uint            log_tid(void);
+int             log_done(uint);
+void            logtick(void);
+int             log_setlazy(int);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, uint64, int);
-int             pipewrite(struct pipe*, uint64, int);
+void            pipeputback(struct pipe*, char*, int, int);
+int             piperead(struct pipe*, int, uint64, int, int);
+int             pipespace(struct pipe*, int);
+int             pipesplice(struct pipe*, struct pipe*, int, int, int);
+int             pipetake(struct pipe*, char*, int, int);
+int             pipewrite(struct pipe*, int, uint64, int, int);
+int             pipewritepage(struct pipe*, char**, int);
+int             pipepoll(struct pipe*, int, int, struct pollctx*);
+
+// poll.c
+void            pollinit(void);
+int             poll(struct pollfd*, int, int);
+void            polltick(void);
+void            pollwait(struct pollctx*, struct waitq*);
+void            pollwakeup(struct waitq*);
 
 // printf.c
 void            printf(char*, ...);
@@ -90,6 +154,7 @@ void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
+int             kthread(void (*)(void), char*);
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
 struct proc*    myproc();
@@ -106,12 +171,21 @@ int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
 
+// ring.c
+void            ringfree(struct proc*, pagetable_t);
+uint64          ringsetup(void);
+int             ringenter(int);
+
+// start.c
+extern uint64   boottime;
+
 // swtch.S
 void            swtch(struct context*, struct context*);
 
 // spinlock.c
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
+int             holdingany(void);
 void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            push_off(void);
@@ -132,6 +206,9 @@ int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
+// sysfile.c
+int             fileopen(char*, int);
+
 // syscall.c
 int             argint(int, int*);
 int             argstr(int, char*, int);
@@ -180,7 +257,12 @@ void            plic_complete(int);
 
 // virtio_disk.c
 void            virtio_disk_init(void);
-void            virtio_disk_rw(struct buf *, int);
+int             virtio_disk_submit(struct blkreq *);
+void            virtio_disk_notify(void);
+void            virtio_disk_poll(void);
+int             virtio_disk_polling(void);
+int             virtio_disk_setpoll(int);
+void            virtio_disk_stat(uint64*, uint64*);
 void            virtio_disk_intr(void);
 
 // number of elements in fixed-size array
@@ -0,0 +1,5 @@
+// Error numbers returned, negated, by system calls that need
+// to tell callers more than -1.
+// Both the kernel and user programs use this header file.
+
+#define EAGAIN  11  // no data or room yet; try again (O_NONBLOCK)
@@ -11,6 +11,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "stat.h"
+#include "uio.h"
 #include "proc.h"
 
 struct devsw devsw[NDEV];
@@ -35,6 +36,7 @@ filealloc(void)
   for(f = ftable.file; f < ftable.file + NFILE; f++){
     if(f->ref == 0){
       f->ref = 1;
+      memset(&f->ra, 0, sizeof(f->ra));
       release(&ftable.lock);
       return f;
     }
@@ -71,6 +73,7 @@ fileclose(struct file *f)
   ff = *f;
   f->ref = 0;
   f->type = FD_NONE;
+  f->nonblock = 0;
   release(&ftable.lock);
 
   if(ff.type == FD_PIPE){
@@ -101,10 +104,57 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
+// Read n bytes from inode ip at *poff into addr, advancing *poff,
+// reading ahead according to ra.
+static int
+readinode(struct inode *ip, struct ra *ra, int user_dst, uint64 addr, uint *poff, int n)
+{
+  int r;
+
+  ilock(ip);
+  readahead(ip, ra, *poff, n);
+  if((r = readi(ip, user_dst, addr, *poff, n)) > 0)
+    *poff += r;
+  iunlock(ip);
+  return r;
+}
+
+// Write n bytes from addr to inode ip at *poff, advancing *poff,
+// in as few transactions as the log allows: each reserves log
+// space for what its piece may dirty, up to half the log, so
+// that another writer can share the transaction.
+// Returns n, or -1 if writei() failed.
+static int
+writeinode(struct inode *ip, int user_src, uint64 addr, uint *poff, int n)
+{
+  int r, i = 0;
+
+  while(i < n){
+    int n1 = n - i;
+    if(n1 > writemax(ip, *poff, LOGSIZE/2))
+      n1 = writemax(ip, *poff, LOGSIZE/2);
+
+    begin_opn(writecost(ip, *poff, n1));
+    ilock(ip);
+    if ((r = writei(ip, user_src, addr + i, *poff, n1)) > 0)
+      *poff += r;
+    iunlock(ip);
+    end_op();
+
+    if(r != n1){
+      // error from writei
+      break;
+    }
+    i += r;
+  }
+  return (i == n ? n : -1);
+}
+
 // Read from file f.
-// addr is a user virtual address.
+// If user_dst==1, then addr is a user virtual address;
+// otherwise, addr is a kernel address.
 int
-fileread(struct file *f, uint64 addr, int n)
+fileread(struct file *f, int user_dst, uint64 addr, int n)
 {
   int r = 0;
 
@@ -112,16 +162,13 @@ fileread(struct file *f, uint64 addr, int n)
     return -1;
 
   if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
+    r = piperead(f->pipe, user_dst, addr, n, f->nonblock);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
       return -1;
-    r = devsw[f->major].read(1, addr, n);
+    r = devsw[f->major].read(user_dst, addr, n, f->nonblock);
   } else if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
-      f->off += r;
-    iunlock(f->ip);
+    r = readinode(f->ip, &f->ra, user_dst, addr, &f->off, n);
   } else {
     panic("fileread");
   }
@@ -130,53 +177,229 @@ fileread(struct file *f, uint64 addr, int n)
 }
 
 // Write to file f.
-// addr is a user virtual address.
+// If user_src==1, then addr is a user virtual address;
+// otherwise, addr is a kernel address.
 int
-filewrite(struct file *f, uint64 addr, int n)
+filewrite(struct file *f, int user_src, uint64 addr, int n)
 {
-  int r, ret = 0;
+  int ret = 0;
 
   if(f->writable == 0)
     return -1;
 
   if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
+    ret = pipewrite(f->pipe, user_src, addr, n, f->nonblock);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
       return -1;
-    ret = devsw[f->major].write(1, addr, n);
+    ret = devsw[f->major].write(user_src, addr, n);
   } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
+    ret = writeinode(f->ip, user_src, addr, &f->off, n);
+  } else {
+    panic("filewrite");
+  }
+
+  return ret;
+}
+
+// Read from file f into the user buffers of iov, in order.
+// Stops early at the first short read, so that a pipe or
+// the console is not waited on once some data has arrived.
+// An inode is locked once for the whole vector.
+int
+filereadv(struct file *f, struct iovec *iov, int iovcnt)
+{
+  int i, r, tot = 0;
+
+  if(f->readable == 0)
+    return -1;
+
+  if(f->type == FD_INODE)
+    ilock(f->ip);
+  for(i = 0; i < iovcnt; i++){
+    if(f->type == FD_INODE){
+      readahead(f->ip, &f->ra, f->off, iov[i].len);
+      if((r = readi(f->ip, 1, (uint64)iov[i].base, f->off, iov[i].len)) > 0)
         f->off += r;
-      iunlock(f->ip);
-      end_op();
+    } else {
+      r = fileread(f, 1, (uint64)iov[i].base, iov[i].len);
+    }
+    if(r < 0){
+      if(tot == 0)
+        tot = r;
+      break;
+    }
+    tot += r;
+    if(r < iov[i].len)
+      break;
+  }
+  if(f->type == FD_INODE)
+    iunlock(f->ip);
+  return tot;
+}
 
-      if(r != n1){
-        // error from writei
-        break;
+// Write the user buffers of iov to file f, in order.
+// For an inode, the whole vector goes into one log transaction
+// if it is small enough; otherwise each buffer is written like
+// an ordinary write().
+int
+filewritev(struct file *f, struct iovec *iov, int iovcnt)
+{
+  int i, r, tot = 0;
+  uint n = 0;
+
+  if(f->writable == 0)
+    return -1;
+
+  // the caller has checked that this adds up to an int.
+  for(i = 0; i < iovcnt; i++)
+    n += iov[i].len;
+
+  if(f->type == FD_INODE && n <= writemax(f->ip, f->off, LOGSIZE/2)){
+    begin_opn(writecost(f->ip, f->off, n));
+    ilock(f->ip);
+    for(i = 0; i < iovcnt; i++){
+      if((r = writei(f->ip, 1, (uint64)iov[i].base, f->off, iov[i].len)) > 0){
+        f->off += r;
+        tot += r;
       }
-      i += r;
+      if(r != iov[i].len)
+        break;
     }
-    ret = (i == n ? n : -1);
-  } else {
-    panic("filewrite");
+    iunlock(f->ip);
+    end_op();
+    return (tot == n ? n : -1);
   }
 
-  return ret;
+  for(i = 0; i < iovcnt; i++){
+    if((r = filewrite(f, 1, (uint64)iov[i].base, iov[i].len)) < 0){
+      if(tot == 0)
+        tot = r;
+      break;
+    }
+    tot += r;
+    if(r < iov[i].len)
+      break;
+  }
+  return tot;
+}
+
+// Read from inode file f at offset off, without using or
+// changing f->off. addr is a user virtual address.
+int
+filepread(struct file *f, uint64 addr, int n, uint off)
+{
+  if(f->readable == 0 || f->type != FD_INODE)
+    return -1;
+  return readinode(f->ip, &f->ra, 1, addr, &off, n);
 }
 
+// Write to inode file f at offset off, without using or
+// changing f->off. addr is a user virtual address.
+int
+filepwrite(struct file *f, uint64 addr, int n, uint off)
+{
+  if(f->writable == 0 || f->type != FD_INODE)
+    return -1;
+  return writeinode(f->ip, 1, addr, &off, n);
+}
+
+// Move up to n bytes from file in to file out inside the kernel.
+// If poff is non-zero, in must be an inode; it is read starting
+// at *poff, which is advanced instead of in->off.
+// Data is staged one page at a time in a kernel page that is
+// filled straight from the source (readi() copies out of the
+// buffer cache) and, for a pipe destination, handed to the pipe
+// as a whole page when possible. Pipe-to-pipe transfers go
+// through pipesplice(), which swaps ring pages.
+// Nothing taken from in is lost if out takes only part of it:
+// an inode is rewound, a pipe gets the rest back, and a device
+// is read only as far as a pipe out has room. Returns the
+// number of bytes moved, or -1, or -EAGAIN for a non-blocking
+// pipe.
+int
+filesplice(struct file *in, struct file *out, uint *poff, int n)
+{
+  int r, w, m, back, nonblock, tot = 0;
+  char *pg;
+
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  if(poff && in->type != FD_INODE)
+    return -1;
+
+  if(in->type == FD_PIPE && out->type == FD_PIPE)
+    return pipesplice(in->pipe, out->pipe, n, in->nonblock, out->nonblock);
+
+  if((pg = kalloc()) == 0)
+    return -1;
+
+  // once room in a pipe out has been seen, or bytes have been
+  // taken from a pipe in, finish the write rather than give up.
+  nonblock = in->type == FD_INODE ? out->nonblock : 0;
+
+  while(tot < n){
+    m = n - tot;
+    if(m > PGSIZE)
+      m = PGSIZE;
+
+    if(in->type == FD_DEVICE && out->type == FD_PIPE){
+      if((r = pipespace(out->pipe, out->nonblock)) < 0){
+        if(tot == 0)
+          tot = r;
+        break;
+      }
+      if(m > r)
+        m = r;
+    }
+
+    if(poff){
+      r = readinode(in->ip, &in->ra, 0, (uint64)pg, poff, m);
+    } else if(in->type == FD_PIPE){
+      r = pipetake(in->pipe, pg, m, in->nonblock);
+    } else {
+      r = fileread(in, 0, (uint64)pg, m);
+    }
+    if(r <= 0){
+      if(r < 0 && tot == 0)
+        tot = r;
+      break;
+    }
+
+    if(out->type == FD_PIPE && r == PGSIZE)
+      w = pipewritepage(out->pipe, &pg, nonblock);
+    else if(out->type == FD_PIPE)
+      w = pipewrite(out->pipe, 0, (uint64)pg, r, nonblock);
+    else
+      w = filewrite(out, 0, (uint64)pg, r);
+
+    // give back what out did not take.
+    back = r - (w > 0 ? w : 0);
+    if(in->type == FD_PIPE){
+      pipeputback(in->pipe, pg + r - back, back, r);
+    } else if(back > 0 && in->type == FD_INODE){
+      if(poff){
+        *poff -= back;
+      } else {
+        ilock(in->ip);
+        in->off -= back;
+        iunlock(in->ip);
+      }
+    }
+    if(w != r){
+      if(w > 0)
+        tot += w;
+      else if(tot == 0)
+        tot = w < 0 ? w : -1;
+      break;
+    }
+    tot += r;
+
+    // a short read means the source has nothing more for now.
+    if(r < m)
+      break;
+  }
+
+  kfree(pg);
+  return tot;
+}
@@ -1,11 +1,20 @@
+// Readahead state of an open file.
+struct ra {
+  uint off;    // where the next read starts if access is sequential
+  uint start;  // first block of the latest window read ahead
+  uint size;   // blocks in that window, or 0 if none
+};
+
 struct file {
   enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE } type;
   int ref; // reference count
   char readable;
   char writable;
+  char nonblock;     // O_NONBLOCK: fail with -EAGAIN instead of sleeping
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
+  struct ra ra;      // FD_INODE
   short major;       // FD_DEVICE
 };
 
@@ -26,13 +35,29 @@ struct inode {
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint flags;
+  union {
+    uint addrs[NDIRECT+NLEVEL];
+    uchar data[NINLINE];
+  };
+  uint leaf;          // last indirect block bmap() used that maps
+  uint leafbn;        //   data blocks directly, and the first it maps
+  uint lastalloc;     // block bmap() allocated last, or 0
 };
 
+// processes in poll() waiting for a pipe or device
+// to change state. see poll.c.
+struct waitq {
+  struct pollent *head;
+};
+
+struct pollctx;
+
 // map major device number to device functions.
 struct devsw {
-  int (*read)(int, uint64, int);
+  int (*read)(int, uint64, int, int);
   int (*write)(int, uint64, int);
+  int (*poll)(struct pollctx*);
 };
 
 extern struct devsw devsw[];
@@ -37,6 +37,21 @@ readsb(int dev, struct superblock *sb)
   brelse(bp);
 }
 
+// Read a block of file system metadata: bitmap,
+// inodes, indirect block or directory contents.
+static struct buf*
+mread(uint dev, uint blockno)
+{
+  struct buf *bp;
+
+  bp = bread(dev, blockno);
+  bmeta(bp);
+  return bp;
+}
+
+static void freemapinit(int);
+static void inodemapinit(int);
+
 // Init fs
 void
 fsinit(int dev) {
@@ -44,6 +59,8 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  freemapinit(dev);  // after recovery, which may change the bitmap
+  inodemapinit(dev);
 }
 
 // Zero a block.
@@ -60,27 +77,144 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+#define NBITMAP 2048  // most bitmap blocks: disks up to 16 GB
+
+// In-memory summary of the free bitmap, so that balloc()
+// reads only bitmap blocks that have a free block.
+//
+// In ordered mode, a block freed by a transaction that has not
+// yet been committed and installed must not be reused for file
+// data written in place: installing the transaction could write
+// the block's logged old contents over the data, and a crash
+// before the commit would leave the old owner pointing at it.
+// So, as ext3 does, bfree() keeps a frozen copy of the bitmap
+// block that also marks the blocks freed since, and balloc()
+// gives such allocations only blocks free in both, until the
+// last transaction that freed one there is done.
+struct {
+  struct spinlock lock;
+  int n;                  // bitmap blocks
+  ushort nfree[NBITMAP];  // free blocks each one marks
+  uint hint;              // just past the last block allocated
+  uint ftid[NBITMAP];     // last transaction that froze it, or 0
+  uchar *frozen[NBITMAP]; // its frozen copy; 0 if none could be
+                          //   allocated, and then it is all frozen
+} freemap;
+
+// Bits in bitmap block bi that stand for blocks on the disk.
+static int
+bmapbits(int bi)
+{
+  return min(BPB, sb.size - bi*BPB);
+}
+
+// Count the free blocks marked in each bitmap block.
+static void
+freemapinit(int dev)
+{
+  int bi, b, nbits;
+  struct buf *bp;
+
+  initlock(&freemap.lock, "freemap");
+  freemap.n = (sb.size + BPB - 1) / BPB;
+  if(freemap.n > NBITMAP)
+    panic("freemapinit: disk too big");
+  for(bi = 0; bi < freemap.n; bi++){
+    bp = mread(dev, sb.bmapstart + bi);
+    nbits = bmapbits(bi);
+    for(b = 0; b < nbits; b++){
+      if((bp->data[b/8] & (1 << (b % 8))) == 0)
+        freemap.nfree[bi]++;
+    }
+    brelse(bp);
+  }
+}
+
+// Find a bit clear in bitmap data, and in also if it is not 0,
+// at or after bit start. The bitmaps have nbits bits, scanned
+// a 64-bit word at a time. Returns -1 if there is none.
+static int
+bmapscan(uchar *data, uchar *also, int start, int nbits)
+{
+  uint64 *w = (uint64*)data, *a = (uint64*)also;
+  uint64 free;
+  int k, b;
+
+  for(k = start / 64; k * 64 < nbits; k++){
+    free = ~w[k];
+    if(a)
+      free &= ~a[k];
+    if(k == start / 64)
+      free &= ~0ULL << (start % 64);
+    if(free == 0)
+      continue;
+    for(b = k * 64; (free & 1) == 0; b++)
+      free >>= 1;
+    return b < nbits ? b : -1;
+  }
+  return -1;
+}
+
+// Drop bitmap block bi's frozen copy if the transactions that
+// froze it are done. Caller holds freemap.lock.
+static void
+bthaw(int bi)
+{
+  if(freemap.ftid[bi] == 0 || !log_done(freemap.ftid[bi]))
+    return;
+  if(freemap.frozen[bi])
+    kfree(freemap.frozen[bi]);
+  freemap.frozen[bi] = 0;
+  freemap.ftid[bi] = 0;
+}
+
+// Allocate a disk block, zeroed through the log
+// unless zero is 0, in which case the caller writes
+// it in place and it must not be frozen (see freemap).
+// Take the first free block at or
+// after goal, if it is not 0, so that a file's blocks
+// end up next to one another; otherwise go on from
+// where the last such allocation left off.
 static uint
-balloc(uint dev)
+balloc(uint dev, uint goal, int zero)
 {
-  int b, bi, m;
+  int i, bi, start, b;
   struct buf *bp;
+  uchar *also;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
-        log_write(bp);
-        brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
-      }
+  if(goal == 0 || goal >= sb.size){
+    acquire(&freemap.lock);
+    goal = freemap.hint;
+    release(&freemap.lock);
+  }
+
+  // each bitmap block from goal's on, then
+  // goal's again for the blocks before goal.
+  for(i = 0; i <= freemap.n; i++){
+    bi = (goal / BPB + i) % freemap.n;
+    start = i == 0 ? goal % BPB : 0;
+    if(freemap.nfree[bi] == 0)  // unlocked peek; rechecked below
+      continue;
+    bp = mread(dev, sb.bmapstart + bi);
+    acquire(&freemap.lock);
+    bthaw(bi);
+    also = zero ? 0 : freemap.frozen[bi];
+    if((!zero && freemap.ftid[bi] && also == 0) ||
+       (b = bmapscan(bp->data, also, start, bmapbits(bi))) < 0){
+      release(&freemap.lock);
+      brelse(bp);
+      continue;
     }
+    bp->data[b/8] |= 1 << (b % 8);  // Mark block in use.
+    freemap.nfree[bi]--;
+    freemap.hint = b + bi * BPB + 1;
+    release(&freemap.lock);
+    log_write(bp);
     brelse(bp);
+    b += bi * BPB;
+    if(zero)
+      bzero(dev, b);
+    return b;
   }
   panic("balloc: out of blocks");
 }
@@ -90,13 +224,26 @@ static void
 bfree(int dev, uint b)
 {
   struct buf *bp;
-  int bi, m;
+  int bi, m, fi;
 
-  bp = bread(dev, BBLOCK(b, sb));
+  bp = mread(dev, BBLOCK(b, sb));
   bi = b % BPB;
   m = 1 << (bi % 8);
   if((bp->data[bi/8] & m) == 0)
     panic("freeing free block");
+  fi = b / BPB;
+  acquire(&freemap.lock);
+  if(sb.flags & FS_ORDERED){
+    // freeze it until this transaction is done.
+    bthaw(fi);
+    if(freemap.ftid[fi] == 0 && (freemap.frozen[fi] = kalloc()) != 0)
+      memmove(freemap.frozen[fi], bp->data, BSIZE);
+    if(freemap.frozen[fi])
+      freemap.frozen[fi][bi/8] |= m;
+    freemap.ftid[fi] = log_tid();
+  }
+  freemap.nfree[fi]++;
+  release(&freemap.lock);
   bp->data[bi/8] &= ~m;
   log_write(bp);
   brelse(bp);
@@ -189,29 +336,88 @@ iinit()
 
 static struct inode* iget(uint dev, uint inum);
 
-// Allocate an inode on device dev.
+#define NIMAP 32768  // most inodes a file system may have
+
+// In-memory map of the inodes in use, built at mount,
+// so that ialloc() need not read inode blocks to find one.
+struct {
+  struct spinlock lock;
+  uint64 map[NIMAP/64];  // bit i set: inode i in use
+  uint hint;             // just past the last inode allocated
+} inodemap;
+
+static void
+inodemapinit(int dev)
+{
+  int inum;
+  struct buf *bp;
+  struct dinode *dip;
+
+  initlock(&inodemap.lock, "inodemap");
+  if(sb.ninodes > NIMAP)
+    panic("inodemapinit: too many inodes");
+  inodemap.map[0] = 1;  // there is no inode 0
+  bp = 0;
+  for(inum = 1; inum < sb.ninodes; inum++){
+    if(bp == 0 || inum%IPB == 0){
+      if(bp)
+        brelse(bp);
+      bp = mread(dev, IBLOCK(inum, sb));
+    }
+    dip = (struct dinode*)bp->data + inum%IPB;
+    if(dip->type != 0)
+      inodemap.map[inum/64] |= 1ULL << (inum%64);
+  }
+  if(bp)
+    brelse(bp);
+  inodemap.hint = 1;
+}
+
+// Mark inum free in the in-memory map.
+static void
+inodemapfree(uint inum)
+{
+  acquire(&inodemap.lock);
+  inodemap.map[inum/64] &= ~(1ULL << (inum%64));
+  release(&inodemap.lock);
+}
+
+// Allocate an inode on device dev, at or after inode near
+// if it is not 0 -- usually the new inode's directory, so
+// that the two share an inode block.
 // Mark it as allocated by  giving it type type.
 // Returns an unlocked but allocated and referenced inode.
 struct inode*
-ialloc(uint dev, short type)
+ialloc(uint dev, short type, uint near)
 {
   int inum;
   struct buf *bp;
   struct dinode *dip;
 
-  for(inum = 1; inum < sb.ninodes; inum++){
-    bp = bread(dev, IBLOCK(inum, sb));
+  for(;;){
+    acquire(&inodemap.lock);
+    if(near == 0 || near >= sb.ninodes)
+      near = inodemap.hint;
+    if((inum = bmapscan((uchar*)inodemap.map, 0, near, sb.ninodes)) < 0 &&
+       (inum = bmapscan((uchar*)inodemap.map, 0, 1, sb.ninodes)) < 0)
+      panic("ialloc: no inodes");
+    inodemap.map[inum/64] |= 1ULL << (inum%64);
+    inodemap.hint = inum + 1;
+    release(&inodemap.lock);
+
+    bp = mread(dev, IBLOCK(inum, sb));
     dip = (struct dinode*)bp->data + inum%IPB;
     if(dip->type == 0){  // a free inode
       memset(dip, 0, sizeof(*dip));
       dip->type = type;
+      if(type == T_FILE)
+        dip->flags = DI_INLINE;  // until it outgrows NINLINE
       log_write(bp);   // mark it allocated on the disk
       brelse(bp);
       return iget(dev, inum);
     }
-    brelse(bp);
+    brelse(bp);  // in use after all; leave it marked
   }
-  panic("ialloc: no inodes");
 }
 
 // Copy a modified in-memory inode to disk.
@@ -224,14 +430,15 @@ iupdate(struct inode *ip)
   struct buf *bp;
   struct dinode *dip;
 
-  bp = bread(ip->dev, IBLOCK(ip->inum, sb));
+  bp = mread(ip->dev, IBLOCK(ip->inum, sb));
   dip = (struct dinode*)bp->data + ip->inum%IPB;
   dip->type = ip->type;
   dip->major = ip->major;
   dip->minor = ip->minor;
   dip->nlink = ip->nlink;
   dip->size = ip->size;
-  memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
+  dip->flags = ip->flags;
+  memmove(dip->data, ip->data, sizeof(ip->data));
   log_write(bp);
   brelse(bp);
 }
@@ -297,14 +504,17 @@ ilock(struct inode *ip)
   acquiresleep(&ip->lock);
 
   if(ip->valid == 0){
-    bp = bread(ip->dev, IBLOCK(ip->inum, sb));
+    bp = mread(ip->dev, IBLOCK(ip->inum, sb));
     dip = (struct dinode*)bp->data + ip->inum%IPB;
     ip->type = dip->type;
     ip->major = dip->major;
     ip->minor = dip->minor;
     ip->nlink = dip->nlink;
     ip->size = dip->size;
-    memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+    ip->flags = dip->flags;
+    memmove(ip->data, dip->data, sizeof(ip->data));
+    ip->leaf = 0;
+    ip->lastalloc = 0;
     brelse(bp);
     ip->valid = 1;
     if(ip->type == 0)
@@ -346,6 +556,7 @@ iput(struct inode *ip)
     itrunc(ip);
     ip->type = 0;
     iupdate(ip);
+    inodemapfree(ip->inum);
     ip->valid = 0;
 
     releasesleep(&ip->lock);
@@ -370,68 +581,231 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in the single indirect block ip->addrs[NDIRECT],
+// the next NINDIRECT^2 under the double indirect block
+// ip->addrs[NDIRECT+1], whose entries name single indirect
+// blocks, and the rest under the triple indirect block
+// ip->addrs[NDIRECT+2].
+
+// Allocate a block for ip, just after prev if that is
+// not 0, or else after the block last allocated for ip.
+static uint
+iballoc(struct inode *ip, uint prev, int zero)
+{
+  if(prev == 0)
+    prev = ip->lastalloc;
+  ip->lastalloc = balloc(ip->dev, prev ? prev + 1 : 0, zero);
+  return ip->lastalloc;
+}
 
 // Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// If there is no such block, bmapfresh allocates one. A new
+// data block is zeroed, unless fresh is not 0, in which case
+// *fresh is set and the caller must fill the whole block.
 static uint
-bmap(struct inode *ip, uint bn)
+bmapfresh(struct inode *ip, uint bn, int *fresh)
 {
-  uint addr, *a;
+  uint addr, *a, lbn, span, i;
+  int level;
   struct buf *bp;
 
   if(bn < NDIRECT){
-    if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+    if((addr = ip->addrs[bn]) == 0){
+      ip->addrs[bn] = addr = iballoc(ip, bn > 0 ? ip->addrs[bn-1] : 0, fresh == 0);
+      if(fresh)
+        *fresh = 1;
+    }
     return addr;
   }
-  bn -= NDIRECT;
+  if(bn >= MAXFILE)
+    panic("bmap: out of range");
+
+  // Sequential access stays within one single indirect block
+  // for NINDIRECT blocks; remember it, and walk down to the
+  // next one only when bn leaves it.
+  if(ip->leaf == 0 || bn - ip->leafbn >= NINDIRECT){
+    // Which indirect block is the top of the tree that maps
+    // bn? span is how many blocks each of its entries maps.
+    lbn = bn - NDIRECT;
+    span = 1;
+    for(level = 0; lbn >= span * NINDIRECT; level++){
+      lbn -= span * NINDIRECT;
+      span *= NINDIRECT;
+    }
+    if((addr = ip->addrs[NDIRECT+level]) == 0)
+      ip->addrs[NDIRECT+level] = addr = iballoc(ip, 0, 1);
+    for(; span > 1; span /= NINDIRECT){
+      bp = mread(ip->dev, addr);
+      a = (uint*)bp->data;
+      i = lbn / span;
+      if((addr = a[i]) == 0){
+        a[i] = addr = iballoc(ip, 0, 1);
+        log_write(bp);
+      }
+      brelse(bp);
+      lbn %= span;
+    }
+    ip->leaf = addr;
+    ip->leafbn = bn - lbn;
+  }
 
-  if(bn < NINDIRECT){
-    // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
-    bp = bread(ip->dev, addr);
-    a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
-      log_write(bp);
+  // Load the single indirect block, allocating the data block.
+  bp = mread(ip->dev, ip->leaf);
+  a = (uint*)bp->data;
+  i = bn - ip->leafbn;
+  if((addr = a[i]) == 0){
+    a[i] = addr = iballoc(ip, i > 0 ? a[i-1] : 0, fresh == 0);
+    if(fresh)
+      *fresh = 1;
+    log_write(bp);
+  }
+  brelse(bp);
+  return addr;
+}
+
+static uint
+bmap(struct inode *ip, uint bn)
+{
+  return bmapfresh(ip, bn, 0);
+}
+
+// itrunc() frees at most this many bitmap blocks' worth of
+// a file per transaction, leaving room in MAXOPBLOCKS for the
+// inode, the indirect blocks it stops in, and the caller's own
+// writes.
+#define TRUNCBITMAP 4
+
+// Progress of itrunc() through one transaction.
+struct trunc {
+  uint dev;
+  uint bblock;  // bitmap block of the last block freed
+  int left;     // bitmap blocks it may still move to
+  uint cut;     // lowest file block freed so far
+};
+
+// Free block b, unless that needs a bitmap block beyond the
+// transaction's share.
+static int
+tfree(struct trunc *t, uint b)
+{
+  if(BBLOCK(b, sb) != t->bblock){
+    if(t->left == 0)
+      return -1;
+    t->left--;
+    t->bblock = BBLOCK(b, sb);
+  }
+  bfree(t->dev, b);
+  return 0;
+}
+
+// Free the blocks under indirect block addr, which maps the
+// file blocks from base on, last first, and then addr itself.
+// depth is how many levels of indirect blocks are below it.
+// Returns 1 if addr was freed, or 0 if t ran out first.
+static int
+ifree(struct trunc *t, uint addr, int depth, uint base)
+{
+  struct buf *bp;
+  uint *a, span;
+  int j, done, dirty;
+
+  for(span = 1, j = 0; j < depth; j++)
+    span *= NINDIRECT;
+  bp = mread(t->dev, addr);
+  a = (uint*)bp->data;
+  done = 1;
+  dirty = 0;
+  for(j = NINDIRECT-1; j >= 0; j--){
+    if(a[j] == 0)
+      continue;
+    if(depth > 0 ? !ifree(t, a[j], depth-1, base + j*span)
+                 : tfree(t, a[j]) < 0){
+      done = 0;
+      break;
     }
+    a[j] = 0;
+    dirty = 1;
+    if(depth == 0)
+      t->cut = base + j;
+  }
+  if(done && tfree(t, addr) == 0){
     brelse(bp);
-    return addr;
+    return 1;
   }
+  // addr stays, so the entries just freed must go on disk.
+  if(dirty)
+    log_write(bp);
+  brelse(bp);
+  return 0;
+}
+
+// Free ip's blocks, last first, as far as one transaction's
+// share goes, shrinking ip->size to below the ones left.
+// Returns 1 when all are freed, or 0 if the share ran out.
+static int
+itruncsome(struct inode *ip)
+{
+  struct trunc t;
+  uint base, span;
+  int i, j;
+
+  t.dev = ip->dev;
+  t.bblock = 0;
+  t.left = TRUNCBITMAP;
+  t.cut = (ip->size + BSIZE - 1) / BSIZE;
+
+  for(i = NLEVEL-1; i >= 0; i--){
+    if(ip->addrs[NDIRECT+i] == 0)
+      continue;
+    base = NDIRECT;
+    for(j = 0, span = NINDIRECT; j < i; j++, span *= NINDIRECT)
+      base += span;
+    if(!ifree(&t, ip->addrs[NDIRECT+i], i, base))
+      goto out;
+    ip->addrs[NDIRECT+i] = 0;
+  }
+  for(i = NDIRECT-1; i >= 0; i--){
+    if(ip->addrs[i] == 0)
+      continue;
+    if(tfree(&t, ip->addrs[i]) < 0)
+      goto out;
+    ip->addrs[i] = 0;
+    t.cut = i;
+  }
+  return 1;
 
-  panic("bmap: out of range");
+out:
+  if(t.cut < (ip->size + BSIZE - 1) / BSIZE)
+    ip->size = t.cut * BSIZE;
+  return 0;
 }
 
-// Truncate inode (discard contents).
-// Caller must hold ip->lock.
+// Truncate inode (discard contents). A big file takes several
+// transactions; the file on disk is whole, just shorter, after
+// each. Caller must hold ip->lock, which is let go between
+// them, and no other inode's lock.
 void
 itrunc(struct inode *ip)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
-
-  for(i = 0; i < NDIRECT; i++){
-    if(ip->addrs[i]){
-      bfree(ip->dev, ip->addrs[i]);
-      ip->addrs[i] = 0;
-    }
+  if(ip->flags & DI_INLINE){
+    memset(ip->data, 0, sizeof(ip->data));
+    ip->size = 0;
+    iupdate(ip);
+    return;
   }
 
-  if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint*)bp->data;
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
-    }
-    brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
+  while(!itruncsome(ip)){
+    ip->leaf = 0;
+    iupdate(ip);
+    iunlock(ip);
+    log_restart();
+    ilock(ip);
   }
+  ip->leaf = 0;
+  ip->lastalloc = 0;
 
+  if(ip->type == T_FILE)
+    ip->flags |= DI_INLINE;  // an empty file starts over inline
   ip->size = 0;
   iupdate(ip);
 }
@@ -446,6 +820,10 @@ stati(struct inode *ip, struct stat *st)
   st->type = ip->type;
   st->nlink = ip->nlink;
   st->size = ip->size;
+  if(ip->flags & DI_INLINE)
+    st->blocks = 0;
+  else
+    st->blocks = (ip->size + BSIZE - 1) / BSIZE;
 }
 
 // Read data from inode.
@@ -463,8 +841,17 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   if(off + n > ip->size)
     n = ip->size - off;
 
+  if(ip->flags & DI_INLINE){
+    if(either_copyout(user_dst, dst, ip->data + off, n) == -1)
+      return -1;
+    return n;
+  }
+
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    if(ip->type == T_DIR)
+      bp = mread(ip->dev, bmap(ip, off/BSIZE));
+    else
+      bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
     if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
       brelse(bp);
@@ -476,6 +863,137 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   return tot;
 }
 
+#define RAMIN  4   // blocks in the first readahead window
+#define RAMAX  32  // most blocks in a readahead window
+
+// Start reading blocks bn up to but not including end of
+// ip into the cache, without waiting.
+static void
+prefetch(struct inode *ip, uint bn, uint end)
+{
+  uint addr, run, n;
+
+  blk_plug();
+  run = n = 0;
+  for(; bn < end; bn++){
+    addr = bmap(ip, bn);
+    if(n > 0 && addr != run + n){
+      breadahead(ip->dev, run, n);
+      n = 0;
+    }
+    if(n++ == 0)
+      run = addr;
+  }
+  if(n > 0)
+    breadahead(ip->dev, run, n);
+  blk_unplug();
+}
+
+// A read of n bytes at off from ip is about to happen.
+// Start reading its blocks, and if the reads through ra
+// have been sequential, the blocks after them, in a window
+// that doubles up to RAMAX blocks each time the reader
+// reaches the previous one.
+// Caller must hold ip->lock.
+void
+readahead(struct inode *ip, struct ra *ra, uint off, uint n)
+{
+  uint bn, last, end, nblocks;
+  int seq;
+
+  if(ip->type != T_FILE || (ip->flags & DI_INLINE) ||
+     off >= ip->size || n == 0)
+    return;
+  if(n > ip->size - off)
+    n = ip->size - off;
+  seq = (off == ra->off);
+  ra->off = off + n;
+
+  bn = off / BSIZE;
+  last = (off + n - 1) / BSIZE;
+  nblocks = (ip->size + BSIZE - 1) / BSIZE;
+  if(!seq){
+    ra->size = 0;
+  } else if(ra->size == 0){
+    ra->start = last + 1;
+    ra->size = RAMIN;
+  } else if(last >= ra->start){
+    ra->start += ra->size;
+    if(ra->start <= last)
+      ra->start = last + 1;
+    ra->size = min(ra->size * 2, RAMAX);
+  } else {
+    // still short of the window read ahead last time.
+    if(last > bn)
+      prefetch(ip, bn, last + 1);
+    return;
+  }
+
+  end = last + 1;
+  if(ra->size > 0)
+    end = min(ra->start + ra->size, nblocks);
+  if(end > bn + 1)
+    prefetch(ip, bn, end);
+}
+
+// How many blocks may a writei() of n bytes at off to ip
+// add to the log? In ordered mode, a file's data is not
+// logged, only the metadata that allocating it dirties.
+int
+writecost(struct inode *ip, uint off, uint n)
+{
+  uint nb;
+  int cost;
+
+  nb = n == 0 ? 0 : (off + n - 1) / BSIZE - off / BSIZE + 1;
+  cost = 1;                      // the inode
+  cost += nb / NINDIRECT + 2;    // single indirect blocks,
+  cost += nb / (NINDIRECT*NINDIRECT) + 2;  // double ones above them,
+  cost += 1;                     // and a triple one
+  cost += nb / BPB + 2;          // bitmap blocks
+  if(!((sb.flags & FS_ORDERED) && ip->type == T_FILE))
+    cost += nb;                  // the data
+  return cost;
+}
+
+// The most bytes, at least one block's worth, that a writei()
+// to ip at off can write while adding at most max blocks to
+// the log.
+uint
+writemax(struct inode *ip, uint off, int max)
+{
+  uint lo, hi, mid;
+
+  // binary search for the most blocks that fit.
+  lo = 1;
+  hi = MAXFILE;
+  while(lo < hi){
+    mid = lo + (hi - lo + 1) / 2;
+    if(writecost(ip, off, mid * BSIZE - off % BSIZE) <= max)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return lo * BSIZE - off % BSIZE;
+}
+
+// Move the data of inline inode ip, which is about to
+// outgrow it, out to a block.
+static void
+ispill(struct inode *ip)
+{
+  uchar data[NINLINE];
+  uint n;
+
+  n = ip->size;
+  memmove(data, ip->data, n);
+  memset(ip->data, 0, sizeof(ip->data));
+  ip->flags &= ~DI_INLINE;
+  ip->size = 0;
+  if(writei(ip, 0, (uint64)data, 0, n) != n)
+    panic("ispill");
+}
+
 // Write data to inode.
 // Caller must hold ip->lock.
 // If user_src==1, then src is a user virtual address;
@@ -486,23 +1004,56 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 int
 writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 {
-  uint tot, m;
+  uint tot, m, addr;
   struct buf *bp;
+  int ordered, fresh;
 
   if(off > ip->size || off + n < off)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
+  if(ip->flags & DI_INLINE){
+    if(off + n <= NINLINE){
+      if(either_copyin(ip->data + off, user_src, src, n) == -1)
+        return -1;
+      if(off + n > ip->size)
+        ip->size = off + n;
+      iupdate(ip);
+      return n;
+    }
+    ispill(ip);
+  }
+
+  // In ordered mode, file data is not logged but written in
+  // place, and the committer waits for those writes before it
+  // commits the metadata that refers to them.
+  ordered = (sb.flags & FS_ORDERED) && ip->type == T_FILE;
+
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    fresh = 0;
+    addr = bmapfresh(ip, off/BSIZE, ordered ? &fresh : 0);
+    if(fresh){
+      bp = bgrab(ip->dev, addr);  // new: no need to read it
+      memset(bp->data, 0, BSIZE);
+    } else if(ip->type == T_DIR)
+      bp = mread(ip->dev, addr);
+    else
+      bp = bread(ip->dev, addr);
     m = min(n - tot, BSIZE - off%BSIZE);
     if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
-      brelse(bp);
+      if(ordered)
+        bawrite(bp);  // a fresh block must reach the disk zeroed
+      else
+        brelse(bp);
       break;
     }
-    log_write(bp);
-    brelse(bp);
+    if(ordered){
+      bawrite(bp);
+    } else {
+      log_write(bp);
+      brelse(bp);
+    }
   }
 
   if(off > ip->size)
@@ -518,23 +1069,113 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 
 // Directories
 
+#define DPB (BSIZE / sizeof(struct dirent))  // dirents per block
+
 int
 namecmp(const char *s, const char *t)
 {
   return strncmp(s, t, DIRSIZ);
 }
 
+// FNV-1a hash of a directory entry name. mkfs has a copy.
+static uint
+namehash(const char *name)
+{
+  uint h = 2166136261;
+  int i;
+
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = (h ^ (uchar)name[i]) * 16777619;
+  return h;
+}
+
+// A hashed directory's index blocks, locked.
+struct dirindex {
+  struct buf *bp[DIRIDXBLOCKS];
+  struct dirhead *hd;
+};
+
+// If dp is hashed, read its index into ix and return 1.
+static int
+idxread(struct inode *dp, struct dirindex *ix)
+{
+  int i;
+
+  if(dp->size < (DIRIDXBLOCKS+1) * BSIZE)
+    return 0;
+  ix->bp[0] = mread(dp->dev, bmap(dp, 0));
+  ix->hd = (struct dirhead*)ix->bp[0]->data;
+  if(ix->hd->inum != 0 || ix->hd->magic != DIRMAGIC){
+    brelse(ix->bp[0]);
+    return 0;
+  }
+  for(i = 1; i < DIRIDXBLOCKS; i++)
+    ix->bp[i] = mread(dp->dev, bmap(dp, i));
+  return 1;
+}
+
+static void
+idxrelse(struct dirindex *ix, int dirty)
+{
+  int i;
+
+  for(i = 0; i < DIRIDXBLOCKS; i++){
+    if(dirty)
+      log_write(ix->bp[i]);
+    brelse(ix->bp[i]);
+  }
+}
+
+// Entry k of the index table.
+static ushort*
+idxent(struct dirindex *ix, uint k)
+{
+  uint s = 1 + k / DIRIDXPER;  // after the head
+  struct dirslot *ds = (struct dirslot*)ix->bp[s / DPB]->data + s % DPB;
+
+  return &ds->leaf[k % DIRIDXPER];
+}
+
+// The leaf that holds names with hash h.
+static uint
+idxleaf(struct dirindex *ix, uint h)
+{
+  return *idxent(ix, h & ((1 << ix->hd->depth) - 1));
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
-  struct dirent de;
+  uint off, inum, leaf;
+  struct dirent de, *dep;
+  struct dirindex ix;
+  struct buf *bp;
+  int i;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
+  if(idxread(dp, &ix)){
+    // only the one leaf the name hashes to.
+    leaf = idxleaf(&ix, namehash(name));
+    idxrelse(&ix, 0);
+    bp = mread(dp->dev, bmap(dp, leaf));
+    dep = (struct dirent*)bp->data;
+    for(i = 0; i < DPB; i++, dep++){
+      if(dep->inum != 0 && namecmp(name, dep->name) == 0){
+        if(poff)
+          *poff = leaf * BSIZE + i * sizeof(de);
+        inum = dep->inum;
+        brelse(bp);
+        return iget(dp->dev, inum);
+      }
+    }
+    brelse(bp);
+    return 0;
+  }
+
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlookup read");
@@ -552,6 +1193,126 @@ dirlookup(struct inode *dp, char *name, uint *poff)
   return 0;
 }
 
+// Turn linear directory dp, whose one block is full, into a
+// hashed one: move the entries to a leaf after the index, and
+// point the whole table, of depth 0, at that leaf.
+static void
+dirhash(struct inode *dp)
+{
+  struct buf *ibp, *lbp;
+  struct dirhead *hd;
+  int i;
+
+  for(i = 1; i < DIRIDXBLOCKS; i++)
+    bmap(dp, i);  // allocate zeroed index blocks
+  ibp = mread(dp->dev, bmap(dp, 0));
+  lbp = mread(dp->dev, bmap(dp, DIRIDXBLOCKS));
+  memmove(lbp->data, ibp->data, BSIZE);
+  log_write(lbp);
+  brelse(lbp);
+
+  memset(ibp->data, 0, BSIZE);
+  hd = (struct dirhead*)ibp->data;
+  hd->magic = DIRMAGIC;
+  hd->depth = 0;
+  ((struct dirslot*)ibp->data)[1].leaf[0] = DIRIDXBLOCKS;
+  log_write(ibp);
+  brelse(ibp);
+
+  dp->size = (DIRIDXBLOCKS+1) * BSIZE;
+  iupdate(dp);
+}
+
+// Split the full leaf of hashed directory dp that holds names
+// with hash h, moving about half of its entries to a new leaf
+// at the end of dp. Doubles the table if only one of its
+// entries points at the leaf. Returns -1 if the table can
+// grow no more.
+static int
+dirsplit(struct inode *dp, struct dirindex *ix, uint h)
+{
+  uint leaf, nleaf, k, n, bit;
+  struct buf *obp, *nbp;
+  struct dirent *ode, *nde;
+  int i;
+
+  leaf = idxleaf(ix, h);
+  n = 0;
+  for(k = 0; k < (1 << ix->hd->depth); k++)
+    if(*idxent(ix, k) == leaf)
+      n++;
+  if(n == 1){
+    if(ix->hd->depth == DIRMAXDEPTH)
+      return -1;
+    for(k = 0; k < (1 << ix->hd->depth); k++)
+      *idxent(ix, k + (1 << ix->hd->depth)) = *idxent(ix, k);
+    ix->hd->depth++;
+    n = 2;
+  }
+
+  // The leaf's names agree on the low bits of their hashes
+  // below bit; split them on that one.
+  for(bit = ix->hd->depth; n > 1; n >>= 1)
+    bit--;
+  nleaf = dp->size / BSIZE;
+  nbp = mread(dp->dev, bmap(dp, nleaf));
+  dp->size += BSIZE;
+  iupdate(dp);
+  for(k = 0; k < (1 << ix->hd->depth); k++)
+    if(*idxent(ix, k) == leaf && (k >> bit) & 1)
+      *idxent(ix, k) = nleaf;
+
+  obp = mread(dp->dev, bmap(dp, leaf));
+  ode = (struct dirent*)obp->data;
+  nde = (struct dirent*)nbp->data;
+  for(i = 0; i < DPB; i++){
+    if(ode[i].inum != 0 && (namehash(ode[i].name) >> bit) & 1){
+      nde[i] = ode[i];
+      ode[i].inum = 0;
+    }
+  }
+  log_write(obp);
+  brelse(obp);
+  log_write(nbp);
+  brelse(nbp);
+  return 0;
+}
+
+// Add (name, inum) to hashed directory dp, in the leaf
+// its name hashes to, splitting leaves to make room. The
+// table can double only DIRMAXDEPTH times, so the caller's
+// op must have reserved DIRLINKBLOCKS for this. Returns -1
+// if the leaf is full and cannot be split.
+static int
+dirlinkhash(struct inode *dp, struct dirindex *ix, char *name, uint inum)
+{
+  uint h;
+  struct buf *bp;
+  struct dirent *de;
+  int i, dirty;
+
+  h = namehash(name);
+  for(dirty = 0; ; dirty = 1){
+    bp = mread(dp->dev, bmap(dp, idxleaf(ix, h)));
+    de = (struct dirent*)bp->data;
+    for(i = 0; i < DPB; i++, de++){
+      if(de->inum == 0){
+        strncpy(de->name, name, DIRSIZ);
+        de->inum = inum;
+        log_write(bp);
+        brelse(bp);
+        idxrelse(ix, dirty);
+        return 0;
+      }
+    }
+    brelse(bp);
+    if(dirsplit(dp, ix, h) < 0){
+      idxrelse(ix, dirty);
+      return -1;
+    }
+  }
+}
+
 // Write a new directory entry (name, inum) into the directory dp.
 int
 dirlink(struct inode *dp, char *name, uint inum)
@@ -559,6 +1320,7 @@ dirlink(struct inode *dp, char *name, uint inum)
   int off;
   struct dirent de;
   struct inode *ip;
+  struct dirindex ix;
 
   // Check that name is not present.
   if((ip = dirlookup(dp, name, 0)) != 0){
@@ -566,6 +1328,9 @@ dirlink(struct inode *dp, char *name, uint inum)
     return -1;
   }
 
+  if(idxread(dp, &ix))
+    return dirlinkhash(dp, &ix, name, inum);
+
   // Look for an empty dirent.
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
@@ -574,6 +1339,15 @@ dirlink(struct inode *dp, char *name, uint inum)
       break;
   }
 
+  // A full one-block directory becomes hashed rather than
+  // growing; longer linear ones, from before, stay linear.
+  if(off == BSIZE && dp->size == BSIZE){
+    dirhash(dp);
+    if(!idxread(dp, &ix))
+      panic("dirlink: dirhash");
+    return dirlinkhash(dp, &ix, name, inum);
+  }
+
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
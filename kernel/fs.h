@@ -20,13 +20,22 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint flags;        // FS_*
 };
 
 #define FSMAGIC 0x10203040
 
-#define NDIRECT 12
+#define FS_ORDERED 0x1  // journal only metadata; write file data in place
+
+#define NDIRECT 10
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NLEVEL 3    // single, double and triple indirect blocks
+// The indirect blocks could map NINDIRECT^3 more blocks,
+// but a file's size must fit in a uint.
+#define MAXFILE (0xffffffffU / BSIZE)
+#define NINLINE 112  // bytes of data a file can keep in its inode
+
+#define DI_INLINE 0x1  // dinode flag: the data is in data[], not in blocks
 
 // On-disk inode structure
 struct dinode {
@@ -35,7 +44,11 @@ struct dinode {
   short minor;          // Minor device number (T_DEVICE only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  uint flags;           // DI_*
+  union {
+    uint addrs[NDIRECT+NLEVEL];   // Data block addresses
+    uchar data[NINLINE];          // The data, if DI_INLINE
+  };
 };
 
 // Inodes per block.
@@ -58,3 +71,36 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// A directory that outgrows its first block is hashed: its
+// first DIRIDXBLOCKS blocks hold an index, and each block after
+// them is a leaf with the entries whose names hash to it. The
+// index is a struct dirhead followed by struct dirslots, each
+// the size of a dirent with inum 0, so programs that read the
+// directory just see free entries there. Entry k of the table,
+// leaf[k % DIRIDXPER] of slot k / DIRIDXPER, is the leaf for
+// names whose hash ends in the depth bits k. A directory is
+// linear, as before, if its first entry is in use.
+#define DIRIDXBLOCKS 2
+#define DIRIDXPER 7
+#define DIRMAXDEPTH 9   // (1<<9) <= (DIRIDXBLOCKS*BSIZE/16 - 1) * DIRIDXPER
+#define DIRMAGIC 0x78646968
+
+// Most blocks a dirlink() writes: the index, the directory's
+// inode, its leaf and a new leaf for each of up to DIRMAXDEPTH
+// splits, three indirect blocks, and a bitmap block for each
+// block allocated. System calls that add a name reserve these
+// on top of MAXOPBLOCKS.
+#define DIRLINKBLOCKS (DIRIDXBLOCKS + 1 + 1 + DIRMAXDEPTH + 3 + DIRMAXDEPTH + 3)
+
+struct dirhead {
+  ushort inum;          // 0
+  ushort depth;         // the table has 1<<depth entries
+  uint magic;           // DIRMAGIC
+  uint pad[2];
+};
+
+struct dirslot {
+  ushort inum;          // 0
+  ushort leaf[DIRIDXPER];  // block numbers in the directory
+};
+
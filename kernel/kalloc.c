@@ -21,8 +21,14 @@ struct run {
 struct {
   struct spinlock lock;
   struct run *freelist;
+  int nfree;   // pages on freelist
 } kmem;
 
+// When fewer than KLOW pages are free, kalloc() asks the
+// buffer cache to give back up to KRECLAIM of its pages.
+#define KLOW      256
+#define KRECLAIM  32
+
 void
 kinit()
 {
@@ -59,6 +65,7 @@ kfree(void *pa)
   acquire(&kmem.lock);
   r->next = kmem.freelist;
   kmem.freelist = r;
+  kmem.nfree++;
   release(&kmem.lock);
 }
 
@@ -70,13 +77,28 @@ kalloc(void)
 {
   struct run *r;
 
+  // Reclaiming takes the buffer cache's locks, so only
+  // do it when the caller holds no spinlocks of its own.
+  if(kmem.nfree < KLOW && !holdingany())
+    breclaim(KRECLAIM);
+
   acquire(&kmem.lock);
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
+    kmem.nfree--;
+  }
   release(&kmem.lock);
 
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
   return (void*)r;
 }
+
+// How many pages are free. A hint: the count may
+// change as soon as it is returned.
+int
+kfreecount(void)
+{
+  return kmem.nfree;
+}
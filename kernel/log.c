@@ -3,6 +3,7 @@
 #include "defs.h"
 #include "param.h"
 #include "spinlock.h"
+#include "proc.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
@@ -10,46 +11,82 @@
 // Simple logging that allows concurrent FS system calls.
 //
 // A log transaction contains the updates of multiple FS system
-// calls. The logging system only commits when there are
-// no FS system calls active. Thus there is never
-// any reasoning required about whether a commit might
-// write an uncommitted system call's updates to disk.
+// calls. A transaction is only closed when there are no FS
+// system calls active in it. Thus there is never any reasoning
+// required about whether a commit might write an uncommitted
+// system call's updates to disk.
 //
 // A system call should call begin_op()/end_op() to mark
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// sleeps until the running transaction has been closed.
+// end_op() waits until the transaction it belonged to has
+// committed, if that transaction wrote anything -- unless the
+// log is in lazy mode (sysctl CTL_LAZYCOMMIT), in which end_op()
+// returns at once and the committer waits to close the running
+// transaction until it is COMMITTICKS old, the log is getting
+// full, or a process asks for durability with log_sync().
+//
+// Commits are done by a kernel thread, the committer, and are
+// double buffered: the committer closes the running transaction,
+// copies its blocks into the log's buffers, and then, while it
+// writes them to disk, a new transaction runs. Everything that
+// happens during one commit goes into the next, so under load
+// each commit carries the work of many system calls.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
 //   header block, containing block #s for block A, B, C, ...
+//     and a CRC-32C of those block #s and the blocks' contents
 //   block A
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// The header and the blocks are written as one batch, in any
+// order; recovery installs the transaction only if the
+// checksum matches, so a commit torn by a crash is ignored.
+// In ordered mode, though, the header must not reach the disk
+// before the file data written in place ahead of it, so there
+// the committer waits for all earlier writes, then writes it.
+// The home locations are written from the copies in the log,
+// since the cached blocks may already hold updates of the
+// next transaction. The log is not erased after install:
+// installing the same transaction again is harmless, and
+// the next commit replaces it.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
 struct logheader {
   int n;
+  uint crc;
   int block[LOGSIZE];
 };
 
+#define COMMITTICKS 10  // lazy mode: most ticks a transaction stays open
+
 struct log {
   struct spinlock lock;
   int start;
   int size;
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int reserved;    // log blocks they may still add, at most
+  int closing;     // committer is taking the transaction, please wait.
   int dev;
-  struct logheader lh;
+  int ordered;     // FS_ORDERED: file data is written in place
+  uint tid;        // number of the running transaction
+  uint done;       // number of the last transaction committed
+  int lazy;        // don't commit in end_op(); see above
+  int waiting;     // begin_op()s waiting for log space
+  uint forced;     // log_sync() wants transaction forced committed
+  uint opened;     // ticks when the running transaction wrote first
+  struct logheader lh;   // the running transaction
+  struct logheader clh;  // the committing one; only the committer uses it
 };
 struct log log;
 
 static void recover_from_log(void);
-static void commit();
+static void committer(void);
 
 void
 initlog(int dev, struct superblock *sb)
@@ -61,27 +98,78 @@ initlog(int dev, struct superblock *sb)
   log.start = sb->logstart;
   log.size = sb->nlog;
   log.dev = dev;
+  log.ordered = (sb->flags & FS_ORDERED) != 0;
+  log.tid = 1;
   recover_from_log();
+  if(kthread(committer, "committer") < 0)
+    panic("initlog: committer");
+}
+
+// Does the checksum in the header read from disk
+// match the block numbers and blocks in the log?
+static int
+log_valid(void)
+{
+  int tail;
+  uint crc;
+  struct buf *lbuf;
+
+  breadahead(log.dev, log.start+1, log.lh.n); // the whole log at once
+
+  crc = crc32c(0, log.lh.block, log.lh.n * sizeof(int));
+  for (tail = 0; tail < log.lh.n; tail++) {
+    lbuf = bread(log.dev, log.start+tail+1);
+    crc = crc32c(crc, lbuf->data, BSIZE);
+    brelse(lbuf);
+  }
+  return crc == log.lh.crc;
 }
 
 // Copy committed blocks from log to their home location
+// after a crash, before anything else uses the file system.
 static void
-install_trans(int recovering)
+recover_trans(void)
 {
-  int tail;
+  int tail, n = 0;
+  struct buf *dbuf[MAXSEG];
 
   for (tail = 0; tail < log.lh.n; tail++) {
     struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
+    dbuf[n] = bgrab(log.dev, log.lh.block[tail]); // dst, overwritten
+    memmove(dbuf[n]->data, lbuf->data, BSIZE);  // copy block to dst
     brelse(lbuf);
-    brelse(dbuf);
+    if(++n == MAXSEG || tail == log.lh.n-1){
+      bawritev(dbuf, n);  // write dsts to disk, then release them
+      n = 0;
+    }
   }
+  bflush();
 }
 
+// Write the committed blocks from their copies in the log
+// to their home locations, and unpin the cached blocks.
+static void
+install_trans(void)
+{
+  int tail, i, n = 0;
+  struct buf *lbuf[MAXSEG], *b;
+  uint home[MAXSEG];
+
+  for (tail = 0; tail < log.clh.n; tail++) {
+    lbuf[n] = bread(log.dev, log.start+tail+1); // read log block
+    home[n] = log.clh.block[tail];
+    if(++n == MAXSEG || tail == log.clh.n-1){
+      bwriteto(lbuf, home, n);
+      for(i = 0; i < n; i++){
+        brelse(lbuf[i]);
+        b = bread(log.dev, home[i]);  // pinned, so still cached
+        bunpin(b);
+        brelse(b);
+      }
+      n = 0;
+    }
+  }
+}
 // Read the log header from disk into the in-memory log header
 static void
 read_head(void)
@@ -90,25 +178,36 @@ read_head(void)
   struct logheader *lh = (struct logheader *) (buf->data);
   int i;
   log.lh.n = lh->n;
+  log.lh.crc = lh->crc;
+  if (log.lh.n < 0 || log.lh.n > LOGSIZE)
+    log.lh.n = 0;  // garbage; nothing committed
   for (i = 0; i < log.lh.n; i++) {
     log.lh.block[i] = lh->block[i];
   }
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
-static void
-write_head(void)
+// Return a locked buf holding log header lh,
+// ready to be written to disk.
+static struct buf*
+head_buf(struct logheader *lh)
 {
-  struct buf *buf = bread(log.dev, log.start);
+  struct buf *buf = bgrab(log.dev, log.start);
   struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  hb->n = lh->n;
+  hb->crc = lh->crc;
+  for (i = 0; i < lh->n; i++) {
+    hb->block[i] = lh->block[i];
   }
+  return buf;
+}
+
+// Write log header lh to disk.
+static void
+write_head(struct logheader *lh)
+{
+  struct buf *buf = head_buf(lh);
   bwrite(buf);
   brelse(buf);
 }
@@ -117,94 +216,189 @@ static void
 recover_from_log(void)
 {
   read_head();
-  install_trans(1); // if committed, copy from log to disk
+  if(log.lh.n > 0 && !log_valid()){
+    printf("log: ignoring torn commit\n");
+    log.lh.n = 0;
+  }
+  recover_trans(); // if committed, copy from log to disk
   log.lh.n = 0;
-  write_head(); // clear the log
+  write_head(&log.lh); // clear the log
 }
 
-// called at the start of each FS system call.
+// called at the start of each FS system call that
+// may write at most n blocks.
 void
-begin_op(void)
+begin_opn(int n)
 {
+  if(n > LOGSIZE)
+    panic("begin_opn");
   acquire(&log.lock);
   while(1){
-    if(log.committing){
+    if(log.closing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+    } else if(log.lh.n + log.reserved + n > LOGSIZE){
       // this op might exhaust log space; wait for commit.
+      log.waiting++;
+      wakeup(&log.tid);  // in lazy mode, don't let the committer dawdle
       sleep(&log, &log.lock);
+      log.waiting--;
     } else {
       log.outstanding += 1;
+      log.reserved += n;
+      myproc()->logres = n;
       release(&log.lock);
       break;
     }
   }
 }
 
+// called at the start of each FS system call.
+void
+begin_op(void)
+{
+  begin_opn(MAXOPBLOCKS);
+}
+
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// waits for the transaction to commit, unless
+// nothing has been written in it or the log is lazy.
 void
 end_op(void)
 {
-  int do_commit = 0;
+  uint tid;
 
   acquire(&log.lock);
   log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
-  if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
-  } else {
-    // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
-    wakeup(&log);
+  log.reserved -= myproc()->logres;
+  if(log.closing)
+    panic("log.closing");
+  if(log.outstanding == 0)
+    wakeup(&log.tid);  // the committer can close the transaction
+  // begin_op() may be waiting for log space,
+  // and decrementing log.outstanding has decreased
+  // the amount of reserved space.
+  wakeup(&log);
+
+  tid = log.tid;
+  if(log.lh.n > 0 && !log.lazy){
+    while((int)(log.done - tid) < 0)
+      sleep(&log.done, &log.lock);
   }
   release(&log.lock);
+}
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
-  }
+// End the calling FS system call's op and begin another with
+// the same reservation, so that a long one, like itrunc(),
+// can be spread over several transactions. The file system
+// must be consistent at this point, and the caller must hold
+// no lock that another op might wait for.
+void
+log_restart(void)
+{
+  int n;
+
+  n = myproc()->logres;
+  end_op();
+  begin_opn(n);
 }
 
-// Copy modified blocks from cache to log.
+// Copy the committing transaction's blocks from cache to
+// log, checksumming them, and start writing them and, unless
+// the log is ordered, the header as one batch. The log blocks
+// are consecutive, so the block layer merges them into few
+// requests.
 static void
 write_log(void)
 {
   int tail;
+  uint crc;
+  struct buf *to, *from;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
+  blk_plug();
+  crc = crc32c(0, log.clh.block, log.clh.n * sizeof(int));
+  for (tail = 0; tail < log.clh.n; tail++) {
+    to = bgrab(log.dev, log.start+tail+1); // log block
+    from = bread(log.dev, log.clh.block[tail]); // cache block
     memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
     brelse(from);
-    brelse(to);
+    crc = crc32c(crc, to->data, BSIZE);
+    bawrite(to);  // write the log, then release the buf
   }
+  log.clh.crc = crc;
+  if(!log.ordered)
+    bawrite(head_buf(&log.clh));
+  blk_unplug();
+}
+
+// Should the committer close the running transaction now?
+// Caller holds log.lock.
+static int
+commitdue(void)
+{
+  if(log.outstanding > 0 || log.lh.n == 0)
+    return 0;
+  if(!log.lazy)
+    return 1;
+  return log.waiting > 0 || log.forced == log.tid ||
+         ticks - log.opened >= COMMITTICKS;
 }
 
+// The committer kernel thread. Closes the running transaction
+// once no FS system call is active in it, and commits it while
+// the next one runs.
 static void
-commit()
+committer(void)
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(0); // Now install writes to home locations
+  uint tid;
+  int lingered = 0;
+
+  for(;;){
+    acquire(&log.lock);
+    while(!commitdue())
+      sleep(&log.tid, &log.lock);
+    if(!lingered && !log.lazy && log.lh.n + MAXOPBLOCKS <= LOGSIZE){
+      // let processes that are ready to run join
+      // the transaction before it closes.
+      lingered = 1;
+      release(&log.lock);
+      yield();
+      continue;
+    }
+    lingered = 0;
+
+    // Close it. begin_op() waits until it has been copied.
+    log.closing = 1;
+    log.clh = log.lh;
     log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+    tid = log.tid++;
+    release(&log.lock);
+
+    write_log();     // Copy modified blocks from cache to log, with header
+
+    acquire(&log.lock);
+    log.closing = 0;
+    wakeup(&log);
+    release(&log.lock);
+
+    bflush();        // Wait for the log writes -- the real commit,
+                     // unless ordered
+    if(log.ordered){
+      // the log and the file data are on disk; now commit.
+      bawrite(head_buf(&log.clh));
+      bflush();
+    }
+    install_trans(); // Now install writes to home locations
+
+    acquire(&log.lock);
+    log.done = tid;
+    wakeup(&log.done);
+    release(&log.lock);
   }
 }
 
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache by increasing refcnt.
-// commit()/write_log() will do the disk write.
+// The committer will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -229,8 +423,87 @@ log_write(struct buf *b)
   log.lh.block[i] = b->blockno;
   if (i == log.lh.n) {  // Add new block to log?
     bpin(b);
-    log.lh.n++;
+    if(log.lh.n++ == 0)
+      log.opened = ticks;
+  }
+  release(&log.lock);
+}
+
+
+// Wait until every FS system call that has finished is on
+// disk, committing the running transaction if need be.
+void
+log_sync(void)
+{
+  uint tid;
+
+  // in ordered mode, file data written in place within a
+  // file's size dirties no metadata, so no commit waits for it.
+  bflush();
+
+  acquire(&log.lock);
+  tid = log.tid;
+  if(log.lh.n > 0){
+    log.forced = tid;
+    wakeup(&log.tid);
+  } else {
+    tid--;  // just wait for the one being committed, if any
   }
+  while((int)(log.done - tid) < 0)
+    sleep(&log.done, &log.lock);
   release(&log.lock);
 }
 
+// The running transaction, which an FS system call
+// between begin_op() and end_op() belongs to.
+uint
+log_tid(void)
+{
+  uint tid;
+
+  acquire(&log.lock);
+  tid = log.tid;
+  release(&log.lock);
+  return tid;
+}
+
+// Has transaction tid been committed and installed?
+int
+log_done(uint tid)
+{
+  int done;
+
+  acquire(&log.lock);
+  done = (int)(log.done - tid) >= 0;
+  release(&log.lock);
+  return done;
+}
+
+// Called on every clock tick: in lazy mode, wake the
+// committer once the running transaction is old enough.
+void
+logtick(void)
+{
+  // unlocked peek, as in polltick(); a miss is
+  // caught on the next tick.
+  if(log.lazy && log.lh.n > 0 && ticks - log.opened >= COMMITTICKS)
+    wakeup(&log.tid);
+}
+
+// Turn lazy commits on (1) or off (0), or just report (-1).
+// Returns the old setting.
+int
+log_setlazy(int lazy)
+{
+  int old;
+
+  if(lazy > 1)
+    return -1;
+  acquire(&log.lock);
+  old = log.lazy;
+  if(lazy >= 0)
+    log.lazy = lazy;
+  wakeup(&log.tid);
+  release(&log.lock);
+  return old;
+}
@@ -17,6 +17,7 @@ main()
     printf("xv6 kernel is booting\n");
     printf("\n");
     kinit();         // physical page allocator
+    crcinit();       // checksum tables
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
     procinit();      // process table
@@ -25,8 +26,10 @@ main()
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
+    blkinit();       // block request queue
     iinit();         // inode cache
     fileinit();      // file table
+    pollinit();      // poll() wait queues
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
@@ -6,8 +6,14 @@
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
-#define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define MAXIOV       16  // max buffers in one readv/writev
+#define MAXOPBLOCKS  12  // max # of blocks any FS op writes
+#define LOGSIZE      100  // max data blocks in on-disk log (< BSIZE/4)
+#define MAXSEG       16  // max blocks in one disk request
+#define NBUFMIN      (LOGSIZE*2+MAXSEG*2)  // smallest size of disk block cache
+#define NBUFMAX      2048  // largest size of disk block cache
+#define NBUFRESERVE  4096  // free pages below which the cache stops growing
+#define FSSIZE       2000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define TICKCYCLES   1000000 // timer cycles per tick; about 1/10th second in qemu
+#define PIPEPAGES      2   // pages in each pipe's ring buffer (power of two)
@@ -7,22 +7,51 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "poll.h"
+#include "errno.h"
 
-#define PIPESIZE 512
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+// the ring buffer is PIPEPAGES separately kalloc()ed pages.
+// nread and nwrite wrap around at 2^32, so PIPESIZE must
+// be a power of two.
+#define PIPESIZE (PIPEPAGES*PGSIZE)
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *data[PIPEPAGES]; // ring buffer pages
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
+  uint held;      // bytes taken by pipetake() that may come back
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  struct waitq pollq; // processes in poll()
 };
 
+// Return the address of ring position pos, and set *n to the
+// number of bytes from there to the end of its page, i.e. the
+// longest run that can be copied with a single memmove.
+static char*
+pipeseg(struct pipe *pi, uint pos, uint *n)
+{
+  uint off = pos % PIPESIZE;
+
+  *n = PGSIZE - off % PGSIZE;
+  return pi->data[off / PGSIZE] + off % PGSIZE;
+}
+
+// How many bytes a writer may add now. Caller holds pi->lock.
+static uint
+piperoom(struct pipe *pi)
+{
+  return PIPESIZE - (pi->nwrite - pi->nread) - pi->held;
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
   struct pipe *pi;
+  int i;
 
   pi = 0;
   *f0 = *f1 = 0;
@@ -30,10 +59,16 @@ pipealloc(struct file **f0, struct file **f1)
     goto bad;
   if((pi = (struct pipe*)kalloc()) == 0)
     goto bad;
+  memset(pi->data, 0, sizeof(pi->data));
+  for(i = 0; i < PIPEPAGES; i++)
+    if((pi->data[i] = kalloc()) == 0)
+      goto bad;
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
   pi->nread = 0;
+  pi->held = 0;
+  pi->pollq.head = 0;
   initlock(&pi->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -46,8 +81,12 @@ pipealloc(struct file **f0, struct file **f1)
   return 0;
 
  bad:
-  if(pi)
+  if(pi){
+    for(i = 0; i < PIPEPAGES; i++)
+      if(pi->data[i])
+        kfree(pi->data[i]);
     kfree((char*)pi);
+  }
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -58,6 +97,8 @@ pipealloc(struct file **f0, struct file **f1)
 void
 pipeclose(struct pipe *pi, int writable)
 {
+  int i;
+
   acquire(&pi->lock);
   if(writable){
     pi->writeopen = 0;
@@ -66,17 +107,27 @@ pipeclose(struct pipe *pi, int writable)
     pi->readopen = 0;
     wakeup(&pi->nwrite);
   }
+  pollwakeup(&pi->pollq);
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
+    for(i = 0; i < PIPEPAGES; i++)
+      kfree(pi->data[i]);
     kfree((char*)pi);
   } else
     release(&pi->lock);
 }
 
+// Write n bytes from addr into the pipe.
+// If user_src==1, then addr is a user virtual address;
+// otherwise, addr is a kernel address.
+// If nonblock, return what fits instead of waiting for the
+// reader, or -EAGAIN if nothing fits.
 int
-pipewrite(struct pipe *pi, uint64 addr, int n)
+pipewrite(struct pipe *pi, int user_src, uint64 addr, int n, int nonblock)
 {
   int i = 0;
+  uint m;
+  char *p;
   struct proc *pr = myproc();
 
   acquire(&pi->lock);
@@ -85,29 +136,46 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       release(&pi->lock);
       return -1;
     }
-    if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
+    if(piperoom(pi) == 0){ //DOC: pipewrite-full
+      if(nonblock){
+        if(i == 0)
+          i = -EAGAIN;
+        break;
+      }
       wakeup(&pi->nread);
+      pollwakeup(&pi->pollq);
       sleep(&pi->nwrite, &pi->lock);
     } else {
-      char ch;
-      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
+      // copy as much as fits, up to the end of the
+      // current ring page, with one copyin().
+      p = pipeseg(pi, pi->nwrite, &m);
+      m = min(m, piperoom(pi));
+      m = min(m, n - i);
+      if(either_copyin(p, user_src, addr + i, m) == -1)
         break;
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+      pi->nwrite += m;
+      i += m;
     }
   }
   wakeup(&pi->nread);
+  pollwakeup(&pi->pollq);
   release(&pi->lock);
 
   return i;
 }
 
-int
-piperead(struct pipe *pi, uint64 addr, int n)
+// Read up to n bytes from the pipe into addr.
+// If user_dst==1, then addr is a user virtual address;
+// otherwise, addr is a kernel address.
+// If nonblock, return -EAGAIN instead of waiting for a writer.
+// If hold, keep the room the bytes leave for pipeputback().
+static int
+pipereadhold(struct pipe *pi, int user_dst, uint64 addr, int n, int nonblock, int hold)
 {
   int i;
+  uint m;
+  char *p;
   struct proc *pr = myproc();
-  char ch;
 
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
@@ -115,16 +183,266 @@ piperead(struct pipe *pi, uint64 addr, int n)
       release(&pi->lock);
       return -1;
     }
+    if(nonblock){
+      release(&pi->lock);
+      return -EAGAIN;
+    }
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
+  for(i = 0; i < n; i += m){  //DOC: piperead-copy
     if(pi->nread == pi->nwrite)
       break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+    p = pipeseg(pi, pi->nread, &m);
+    m = min(m, pi->nwrite - pi->nread);
+    m = min(m, n - i);
+    if(either_copyout(user_dst, addr + i, p, m) == -1)
       break;
+    pi->nread += m;
   }
+  if(hold)
+    pi->held += i;
   wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  pollwakeup(&pi->pollq);
   release(&pi->lock);
   return i;
 }
+
+int
+piperead(struct pipe *pi, int user_dst, uint64 addr, int n, int nonblock)
+{
+  return pipereadhold(pi, user_dst, addr, n, nonblock, 0);
+}
+
+// Read up to n bytes from the pipe into kernel buffer dst,
+// like piperead(), but keep the room they leave, so that the
+// caller can give back what it cannot pass on. Every take
+// must be followed by a pipeputback().
+int
+pipetake(struct pipe *pi, char *dst, int n, int nonblock)
+{
+  return pipereadhold(pi, 0, (uint64)dst, n, nonblock, 1);
+}
+
+// End a pipetake() of taken bytes by putting the last back of
+// them, which start at src, back in front of the pipe's data.
+void
+pipeputback(struct pipe *pi, char *src, int back, int taken)
+{
+  int i;
+  uint m;
+  char *p;
+
+  acquire(&pi->lock);
+  pi->held -= taken;
+  pi->nread -= back;
+  for(i = 0; i < back; i += m){
+    p = pipeseg(pi, pi->nread + i, &m);
+    m = min(m, back - i);
+    memmove(p, src + i, m);
+  }
+  if(back > 0){
+    wakeup(&pi->nread);
+    pollwakeup(&pi->pollq);
+  }
+  wakeup(&pi->nwrite);
+  release(&pi->lock);
+}
+
+// Wait until pipe pi has room, and return how much. If
+// nonblock, return -EAGAIN instead of waiting.
+int
+pipespace(struct pipe *pi, int nonblock)
+{
+  int n;
+  struct proc *pr = myproc();
+
+  acquire(&pi->lock);
+  while((n = piperoom(pi)) == 0){
+    if(pi->readopen == 0 || pr->killed){
+      release(&pi->lock);
+      return -1;
+    }
+    if(nonblock){
+      release(&pi->lock);
+      return -EAGAIN;
+    }
+    wakeup(&pi->nread);
+    pollwakeup(&pi->pollq);
+    sleep(&pi->nwrite, &pi->lock);
+  }
+  if(pi->readopen == 0)
+    n = -1;
+  release(&pi->lock);
+  return n;
+}
+
+// Write a full page of data from the kernel page *pg into the
+// pipe. If the write position is page-aligned, the page itself
+// is moved into the ring and *pg is replaced by the free ring
+// page that it displaces, so no data is copied.
+// If nonblock, don't wait for room, as pipewrite().
+int
+pipewritepage(struct pipe *pi, char **pg, int nonblock)
+{
+  uint slot;
+  char *t;
+  struct proc *pr = myproc();
+
+  acquire(&pi->lock);
+  while(pi->nwrite % PGSIZE == 0 && piperoom(pi) < PGSIZE){
+    if(pi->readopen == 0 || pr->killed){
+      release(&pi->lock);
+      return -1;
+    }
+    if(nonblock){
+      release(&pi->lock);
+      return -EAGAIN;
+    }
+    wakeup(&pi->nread);
+    pollwakeup(&pi->pollq);
+    sleep(&pi->nwrite, &pi->lock);
+  }
+  if(pi->nwrite % PGSIZE == 0){
+    if(pi->readopen == 0){
+      release(&pi->lock);
+      return -1;
+    }
+    slot = (pi->nwrite % PIPESIZE) / PGSIZE;
+    t = pi->data[slot];
+    pi->data[slot] = *pg;
+    *pg = t;
+    pi->nwrite += PGSIZE;
+    wakeup(&pi->nread);
+    pollwakeup(&pi->pollq);
+    release(&pi->lock);
+    return PGSIZE;
+  }
+  release(&pi->lock);
+
+  // another writer left the ring unaligned; copy instead.
+  return pipewrite(pi, 0, (uint64)*pg, PGSIZE, nonblock);
+}
+
+// Move up to n bytes from pipe src to pipe dst without copying
+// them through user memory. Waits for src to have data and for
+// dst to have room, like piperead() and pipewrite(), but returns
+// as soon as src runs dry once something has been moved. Whole
+// aligned pages are handed over by swapping ring pages.
+// snonblock and dnonblock say not to wait for src or dst; then
+// it returns -EAGAIN if it would have waited before moving any.
+int
+pipesplice(struct pipe *src, struct pipe *dst, int n, int snonblock, int dnonblock)
+{
+  int tot = 0;
+  uint m, ms, md, ss, ds;
+  char *ps, *pd;
+  struct pipe *first, *second;
+  struct proc *pr = myproc();
+
+  if(src == dst)
+    return -1;
+
+  // lock the two pipes in a fixed order.
+  first = src < dst ? src : dst;
+  second = src < dst ? dst : src;
+
+  while(tot < n){
+    acquire(&src->lock);
+    while(src->nread == src->nwrite && src->writeopen && tot == 0){
+      if(pr->killed){
+        release(&src->lock);
+        return -1;
+      }
+      if(snonblock){
+        release(&src->lock);
+        return -EAGAIN;
+      }
+      sleep(&src->nread, &src->lock);
+    }
+    if(src->nread == src->nwrite){
+      release(&src->lock);
+      break;
+    }
+    release(&src->lock);
+
+    acquire(&dst->lock);
+    while(piperoom(dst) == 0){
+      if(dst->readopen == 0 || pr->killed){
+        release(&dst->lock);
+        return tot > 0 ? tot : -1;
+      }
+      if(dnonblock){
+        release(&dst->lock);
+        return tot > 0 ? tot : -EAGAIN;
+      }
+      wakeup(&dst->nread);
+      pollwakeup(&dst->pollq);
+      sleep(&dst->nwrite, &dst->lock);
+    }
+    if(dst->readopen == 0 || pr->killed){
+      release(&dst->lock);
+      return tot > 0 ? tot : -1;
+    }
+    release(&dst->lock);
+
+    acquire(&first->lock);
+    acquire(&second->lock);
+    while(tot < n){
+      ss = src->nwrite - src->nread;                // bytes in src
+      ds = piperoom(dst);                           // room in dst
+      if(ss == 0 || ds == 0)
+        break;
+      if(src->nread % PGSIZE == 0 && dst->nwrite % PGSIZE == 0 &&
+         ss >= PGSIZE && ds >= PGSIZE && n - tot >= PGSIZE){
+        uint sslot = (src->nread % PIPESIZE) / PGSIZE;
+        uint dslot = (dst->nwrite % PIPESIZE) / PGSIZE;
+        char *t = src->data[sslot];
+        src->data[sslot] = dst->data[dslot];
+        dst->data[dslot] = t;
+        m = PGSIZE;
+      } else {
+        ps = pipeseg(src, src->nread, &ms);
+        pd = pipeseg(dst, dst->nwrite, &md);
+        m = min(ms, md);
+        m = min(m, min(ss, ds));
+        m = min(m, n - tot);
+        memmove(pd, ps, m);
+      }
+      src->nread += m;
+      dst->nwrite += m;
+      tot += m;
+    }
+    wakeup(&src->nwrite);
+    wakeup(&dst->nread);
+    pollwakeup(&src->pollq);
+    pollwakeup(&dst->pollq);
+    release(&second->lock);
+    release(&first->lock);
+  }
+  return tot;
+}
+
+// Report the poll() events for the read and/or write end of pi,
+// after putting ctx on the pipe's wait queue.
+int
+pipepoll(struct pipe *pi, int readable, int writable, struct pollctx *ctx)
+{
+  int r = 0;
+
+  pollwait(ctx, &pi->pollq);
+  acquire(&pi->lock);
+  if(readable){
+    if(pi->nread != pi->nwrite)
+      r |= POLLIN;
+    if(pi->writeopen == 0)
+      r |= POLLHUP;
+  }
+  if(writable){
+    if(pi->readopen == 0)
+      r |= POLLERR;
+    else if(piperoom(pi) > 0)
+      r |= POLLOUT;
+  }
+  release(&pi->lock);
+  return r;
+}
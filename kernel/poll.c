@@ -0,0 +1,195 @@
+//
+// poll(): wait for any of several files to become ready.
+//
+// Pipes and the console keep a wait queue (struct waitq) of
+// the pollers interested in them. poll() puts one entry on the
+// queue of every file it checks, and then sleeps on its own
+// pollctx. A pipe or device that changes state calls
+// pollwakeup() on its queue, which wakes exactly the pollers
+// registered there, so a sleeping poller costs nothing until
+// one of its files has news.
+//
+// Entries are added before a file's state is checked, and
+// pollwakeup() marks the pollctx woken under polllock, so an
+// event that arrives between the check and the sleep is not lost.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "poll.h"
+
+struct pollent {
+  struct pollctx *ctx;
+  struct waitq *q;
+  struct pollent *next;
+};
+
+struct pollctx {
+  int woken;       // a queue we're on was woken
+  uint deadline;   // ticks value at which to time out
+  int nent;
+  struct pollent ent[NOFILE+1]; // one per fd, plus the timer
+};
+
+// protects all wait queues and the woken flags.
+struct spinlock polllock;
+
+// pollers with a timeout; polltick() wakes them when due.
+struct waitq tickwaitq;
+
+void
+pollinit(void)
+{
+  initlock(&polllock, "poll");
+}
+
+// Put ctx on wait queue q.
+// Called by a file's poll function before it looks at its state.
+void
+pollwait(struct pollctx *ctx, struct waitq *q)
+{
+  struct pollent *e;
+
+  if(ctx == 0 || ctx->nent >= NELEM(ctx->ent))
+    return;
+  e = &ctx->ent[ctx->nent++];
+  e->ctx = ctx;
+  e->q = q;
+  acquire(&polllock);
+  e->next = q->head;
+  q->head = e;
+  release(&polllock);
+}
+
+// Wake up the pollers waiting on q.
+void
+pollwakeup(struct waitq *q)
+{
+  struct pollent *e;
+
+  acquire(&polllock);
+  for(e = q->head; e; e = e->next){
+    e->ctx->woken = 1;
+    wakeup(e->ctx);
+  }
+  release(&polllock);
+}
+
+// Called on every clock tick: wake pollers whose timeout expired.
+void
+polltick(void)
+{
+  struct pollent *e;
+
+  // unlocked peek; a poller that is just being added
+  // is caught on the next tick.
+  if(tickwaitq.head == 0)
+    return;
+
+  acquire(&polllock);
+  for(e = tickwaitq.head; e; e = e->next){
+    if((int)(ticks - e->ctx->deadline) >= 0){
+      e->ctx->woken = 1;
+      wakeup(e->ctx);
+    }
+  }
+  release(&polllock);
+}
+
+// Take ctx off all the queues it is on.
+static void
+pollfree(struct pollctx *ctx)
+{
+  struct pollent *e, **pp;
+  int i;
+
+  acquire(&polllock);
+  for(i = 0; i < ctx->nent; i++){
+    e = &ctx->ent[i];
+    for(pp = &e->q->head; *pp; pp = &(*pp)->next){
+      if(*pp == e){
+        *pp = e->next;
+        break;
+      }
+    }
+  }
+  release(&polllock);
+  ctx->nent = 0;
+}
+
+// Check the readiness of f, registering ctx on its wait queue.
+static int
+pollfile(struct file *f, struct pollctx *ctx)
+{
+  if(f->type == FD_PIPE)
+    return pipepoll(f->pipe, f->readable, f->writable, ctx);
+  if(f->type == FD_DEVICE){
+    if(f->major >= 0 && f->major < NDEV && devsw[f->major].poll)
+      return devsw[f->major].poll(ctx);
+  }
+  // regular files never block.
+  return POLLIN | POLLOUT;
+}
+
+// Wait until one of the nfds files in fds is ready for the
+// events it asks for, or for timeout clock ticks (forever if
+// timeout < 0). Fills in revents and returns the number of
+// ready entries, 0 on timeout, or -1 if killed.
+int
+poll(struct pollfd *fds, int nfds, int timeout)
+{
+  struct pollctx ctx;
+  struct proc *p = myproc();
+  struct file *f;
+  int i, n;
+
+  ctx.nent = 0;
+  if(timeout > 0){
+    acquire(&tickslock);
+    ctx.deadline = ticks + timeout;
+    release(&tickslock);
+  }
+
+  for(;;){
+    ctx.woken = 0;
+    n = 0;
+    for(i = 0; i < nfds; i++){
+      fds[i].revents = 0;
+      if(fds[i].fd < 0)
+        continue;
+      if(fds[i].fd >= NOFILE || (f = p->ofile[fds[i].fd]) == 0){
+        fds[i].revents = POLLNVAL;
+      } else {
+        fds[i].revents = pollfile(f, &ctx) &
+          (fds[i].events | POLLERR | POLLHUP);
+      }
+      if(fds[i].revents)
+        n++;
+    }
+    if(n > 0 || timeout == 0)
+      break;
+    if(timeout > 0){
+      pollwait(&ctx, &tickwaitq);
+      if((int)(ticks - ctx.deadline) >= 0)
+        break;
+    }
+
+    acquire(&polllock);
+    while(ctx.woken == 0 && p->killed == 0)
+      sleep(&ctx, &polllock);
+    release(&polllock);
+    pollfree(&ctx);
+
+    if(p->killed)
+      return -1;
+  }
+  pollfree(&ctx);
+  return n;
+}
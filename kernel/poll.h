@@ -0,0 +1,14 @@
+// poll() requests, one per file descriptor.
+// Both the kernel and user programs use this header file.
+
+struct pollfd {
+  int fd;         // file descriptor, or < 0 to skip
+  short events;   // requested events
+  short revents;  // returned events
+};
+
+#define POLLIN    0x001  // there is data to read
+#define POLLOUT   0x004  // writing will not block
+#define POLLERR   0x008  // writing to a pipe with no reader
+#define POLLHUP   0x010  // the other end of a pipe was closed
+#define POLLNVAL  0x020  // fd is not open
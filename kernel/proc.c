@@ -4,6 +4,7 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "vdso.h"
 #include "defs.h"
 
 struct cpu cpus[NCPU];
@@ -16,6 +17,7 @@ int nextpid = 1;
 struct spinlock pid_lock;
 
 extern void forkret(void);
+static void kthreadret(void);
 static void freeproc(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
@@ -127,6 +129,18 @@ found:
     return 0;
   }
 
+  // Allocate the page published read-only at VDSO.
+  if((p->vdso = (struct vdso *)kalloc()) == 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+  memset(p->vdso, 0, PGSIZE);
+  p->vdso->pid = p->pid;
+  p->vdso->boottime = boottime;
+  p->vdso->tickcycles = TICKCYCLES;
+  p->vdso->hz = CLINT_HZ;
+
   // An empty user page table.
   p->pagetable = proc_pagetable(p);
   if(p->pagetable == 0){
@@ -153,13 +167,19 @@ freeproc(struct proc *p)
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
+  if(p->vdso)
+    kfree((void*)p->vdso);
+  p->vdso = 0;
+  if(p->pagetable){
+    ringfree(p, p->pagetable);
     proc_freepagetable(p->pagetable, p->sz);
+  }
   p->pagetable = 0;
   p->sz = 0;
   p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
+  p->kfn = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
@@ -196,6 +216,16 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // map the vdso page below the trapframe, readable
+  // (but not writable) from user space.
+  if(mappages(pagetable, VDSO, PGSIZE,
+              (uint64)(p->vdso), PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
   return pagetable;
 }
 
@@ -206,6 +236,7 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, VDSO, 1, 0);
   uvmfree(pagetable, sz);
 }
 
@@ -318,6 +349,34 @@ fork(void)
   return pid;
 }
 
+// Start a kernel thread running fn(), which must not return.
+// It is a process that never enters user space, a child of init.
+// Returns its pid, or -1.
+int
+kthread(void (*fn)(void), char *name)
+{
+  struct proc *p;
+  int pid;
+
+  if((p = allocproc()) == 0)
+    return -1;
+  p->kfn = fn;
+  p->context.ra = (uint64)kthreadret;
+  safestrcpy(p->name, name, sizeof(p->name));
+  pid = p->pid;
+  release(&p->lock);
+
+  acquire(&wait_lock);
+  p->parent = initproc;
+  release(&wait_lock);
+
+  acquire(&p->lock);
+  p->state = RUNNABLE;
+  release(&p->lock);
+
+  return pid;
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold wait_lock.
 void
@@ -523,6 +582,17 @@ forkret(void)
   usertrapret();
 }
 
+// A kernel thread's very first scheduling by scheduler()
+// will swtch to kthreadret.
+static void
+kthreadret(void)
+{
+  // Still holding p->lock from scheduler.
+  release(&myproc()->lock);
+  myproc()->kfn();
+  panic("kthreadret");
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
@@ -101,7 +101,11 @@ struct proc {
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
   struct trapframe *trapframe; // data page for trampoline.S
+  struct vdso *vdso;           // page user code reads at VDSO
+  struct ring *ring;           // ring page mapped at RING, or 0
   struct context context;      // swtch() here to run process
+  void (*kfn)(void);           // body of a kernel thread, or 0
+  int logres;                  // log blocks reserved by begin_op()
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
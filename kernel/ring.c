@@ -0,0 +1,121 @@
+//
+// Submission/completion rings: a page shared with the process
+// through which it queues read/write/open/close requests and
+// has a whole batch of them run with a single ring_enter trap.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "ring.h"
+
+// Give the current process a ring page, mapped at RING.
+// Return its user address, or -1.
+uint64
+ringsetup(void)
+{
+  struct proc *p = myproc();
+  char *mem;
+
+  if(sizeof(struct ring) > PGSIZE)
+    panic("ringsetup: ring too big");
+
+  if(p->ring)
+    return RING;
+  if((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  if(mappages(p->pagetable, RING, PGSIZE, (uint64)mem, PTE_R|PTE_W|PTE_U) < 0){
+    kfree(mem);
+    return -1;
+  }
+  p->ring = (struct ring*)mem;
+  return RING;
+}
+
+// Unmap p's ring page from pagetable and free it.
+void
+ringfree(struct proc *p, pagetable_t pagetable)
+{
+  if(p->ring == 0)
+    return;
+  uvmunmap(pagetable, RING, 1, 0);
+  kfree((void*)p->ring);
+  p->ring = 0;
+}
+
+// Run one submission entry and return what the
+// equivalent system call would have returned.
+static int
+ringop(struct ring_sqe *e)
+{
+  struct proc *p = myproc();
+  struct file *f;
+  char path[MAXPATH];
+
+  if(e->op == RING_NOP)
+    return 0;
+
+  if(e->op == RING_OPEN){
+    if(fetchstr(e->addr, path, MAXPATH) < 0)
+      return -1;
+    return fileopen(path, e->len);
+  }
+
+  if(e->fd < 0 || e->fd >= NOFILE || (f = p->ofile[e->fd]) == 0)
+    return -1;
+
+  switch(e->op){
+  case RING_READ:
+    if(e->off >= 0)
+      return filepread(f, e->addr, e->len, e->off);
+    return fileread(f, 1, e->addr, e->len);
+  case RING_WRITE:
+    if(e->off >= 0)
+      return filepwrite(f, e->addr, e->len, e->off);
+    return filewrite(f, 1, e->addr, e->len);
+  case RING_CLOSE:
+    p->ofile[e->fd] = 0;
+    fileclose(f);
+    return 0;
+  }
+  return -1;
+}
+
+// Consume up to n submission entries, in order, posting a
+// completion for each. Stops early when the submission ring
+// is empty or the completion ring is full. Every operation
+// has finished by the time this returns.
+// Returns the number of entries consumed, or -1.
+int
+ringenter(int n)
+{
+  struct proc *p = myproc();
+  struct ring *r = p->ring;
+  struct ring_sqe e;
+  struct ring_cqe *c;
+  int i;
+
+  if(r == 0 || n < 0)
+    return -1;
+
+  for(i = 0; i < n && !p->killed; i++){
+    if(r->sq_head == r->sq_tail || r->cq_tail - r->cq_head >= RINGSIZE)
+      break;
+    // the entry lives in user-writable memory; work on a copy.
+    e = r->sq[r->sq_head % RINGSIZE];
+    r->sq_head++;
+    c = &r->cq[r->cq_tail % RINGSIZE];
+    c->user_data = e.user_data;
+    c->res = ringop(&e);
+    r->cq_tail++;
+  }
+  return i;
+}
@@ -0,0 +1,38 @@
+// Submission/completion rings shared between a process and
+// the kernel. ring_setup() maps one page holding a struct ring
+// into the process; the process fills submission entries and
+// advances sq_tail, then ring_enter() runs them and posts one
+// completion per entry. Indices run freely and wrap modulo
+// RINGSIZE.
+
+#define RINGSIZE 64    // entries in each ring (power of two)
+
+#define RING_NOP   0
+#define RING_READ  1   // read(fd, addr, len), or pread if off >= 0
+#define RING_WRITE 2   // write(fd, addr, len), or pwrite if off >= 0
+#define RING_OPEN  3   // open((char*)addr, len)
+#define RING_CLOSE 4   // close(fd)
+
+struct ring_sqe {
+  int op;              // RING_*
+  int fd;
+  uint64 addr;         // user buffer, or path for RING_OPEN
+  int len;             // byte count, or omode for RING_OPEN
+  int off;             // file offset, or -1 to use the fd's offset
+  uint64 user_data;    // copied to the completion untouched
+};
+
+struct ring_cqe {
+  uint64 user_data;
+  int res;             // what the equivalent system call returns
+  int pad;
+};
+
+struct ring {
+  uint sq_head;        // next entry the kernel will consume
+  uint sq_tail;        // next entry the process will fill
+  uint cq_head;        // next completion the process will consume
+  uint cq_tail;        // next completion the kernel will post
+  struct ring_sqe sq[RINGSIZE];
+  struct ring_cqe cq[RINGSIZE];
+};
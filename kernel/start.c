@@ -13,6 +13,9 @@ __attribute__ ((aligned (16))) char stack0[4096 * NCPU];
 // a scratch area per CPU for machine-mode timer interrupts.
 uint64 timer_scratch[NCPU][5];
 
+// mtime when hart 0's timer started, i.e. when ticks was 0.
+uint64 boottime;
+
 // assembly code in kernelvec.S for machine-mode timer interrupt.
 extern void timervec();
 
@@ -41,6 +44,11 @@ start()
   // ask for clock interrupts.
   timerinit();
 
+  // let supervisor and user mode read the time CSR,
+  // so user code can use the calibration in the vdso page.
+  w_mcounteren(r_mcounteren() | COUNTEREN_TM);
+  w_scounteren(r_scounteren() | COUNTEREN_TM);
+
   // keep each CPU's hartid in its tp register, for cpuid().
   int id = r_mhartid();
   w_tp(id);
@@ -60,8 +68,11 @@ timerinit()
   int id = r_mhartid();
 
   // ask the CLINT for a timer interrupt.
-  int interval = 1000000; // cycles; about 1/10th second in qemu.
-  *(uint64*)CLINT_MTIMECMP(id) = *(uint64*)CLINT_MTIME + interval;
+  int interval = TICKCYCLES;
+  uint64 now = *(uint64*)CLINT_MTIME;
+  if(id == 0)
+    boottime = now;
+  *(uint64*)CLINT_MTIMECMP(id) = now + interval;
 
   // prepare information in scratch[] for timervec.
   // scratch[0..2] : space for timervec to save registers.
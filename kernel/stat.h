@@ -8,4 +8,5 @@ struct stat {
   short type;  // Type of file
   short nlink; // Number of links to file
   uint64 size; // Size of file in bytes
+  uint blocks; // Data blocks on disk; 0 if the data is in the inode
 };
@@ -104,6 +104,21 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_wait(void);
 extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
+extern uint64 sys_splice(void);
+extern uint64 sys_sendfile(void);
+extern uint64 sys_poll(void);
+extern uint64 sys_pipe2(void);
+extern uint64 sys_fcntl(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
+extern uint64 sys_pread(void);
+extern uint64 sys_pwrite(void);
+extern uint64 sys_ring_setup(void);
+extern uint64 sys_ring_enter(void);
+extern uint64 sys_blkstat(void);
+extern uint64 sys_sysctl(void);
+extern uint64 sys_fsync(void);
+extern uint64 sys_sync(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -127,6 +142,21 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_splice]  sys_splice,
+[SYS_sendfile] sys_sendfile,
+[SYS_poll]    sys_poll,
+[SYS_pipe2]   sys_pipe2,
+[SYS_fcntl]   sys_fcntl,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_ring_setup] sys_ring_setup,
+[SYS_ring_enter] sys_ring_enter,
+[SYS_blkstat] sys_blkstat,
+[SYS_sysctl]  sys_sysctl,
+[SYS_fsync]   sys_fsync,
+[SYS_sync]    sys_sync,
 };
 
 void
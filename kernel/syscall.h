@@ -20,3 +20,18 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_splice 22
+#define SYS_sendfile 23
+#define SYS_poll   24
+#define SYS_pipe2  25
+#define SYS_fcntl  26
+#define SYS_readv  27
+#define SYS_writev 28
+#define SYS_pread  29
+#define SYS_pwrite 30
+#define SYS_ring_setup 31
+#define SYS_ring_enter 32
+#define SYS_blkstat 33
+#define SYS_sysctl 34
+#define SYS_fsync  35
+#define SYS_sync   36
@@ -0,0 +1,10 @@
+// Kernel knobs for sysctl(name, val), which sets the knob
+// to val (unless val is -1) and returns its previous value.
+#define CTL_DISKPOLL 1  // poll the disk instead of taking interrupts
+#define CTL_BCACHEPOLICY 2  // buffer cache eviction policy, BCACHE_*
+#define CTL_NBUF     3  // most buffers the buffer cache may hold
+#define CTL_DROPCACHE 4 // 1: forget every cached block not in use
+#define CTL_LAZYCOMMIT 5 // 1: don't commit at the end of each FS call
+
+#define BCACHE_LRU   0  // least recently used
+#define BCACHE_2Q    1  // 2Q: scan resistant, favors metadata
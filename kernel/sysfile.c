@@ -15,6 +15,9 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "poll.h"
+#include "uio.h"
+#include "blkstat.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -75,7 +78,7 @@ sys_read(void)
 
   if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
     return -1;
-  return fileread(f, p, n);
+  return fileread(f, 1, p, n);
 }
 
 uint64
@@ -88,7 +91,7 @@ sys_write(void)
   if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
     return -1;
 
-  return filewrite(f, p, n);
+  return filewrite(f, 1, p, n);
 }
 
 uint64
@@ -115,6 +118,29 @@ sys_fstat(void)
   return filestat(f, st);
 }
 
+// Wait until what has been written to the file is on disk.
+// The log commits everything at once, so this is sync()
+// for any file that has an inode.
+uint64
+sys_fsync(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  if(f->type != FD_INODE && f->type != FD_DEVICE)
+    return -1;
+  log_sync();
+  return 0;
+}
+
+uint64
+sys_sync(void)
+{
+  log_sync();
+  return 0;
+}
+
 // Create the path new as a link to the same inode as old.
 uint64
 sys_link(void)
@@ -125,7 +151,7 @@ sys_link(void)
   if(argstr(0, old, MAXPATH) < 0 || argstr(1, new, MAXPATH) < 0)
     return -1;
 
-  begin_op();
+  begin_opn(MAXOPBLOCKS + DIRLINKBLOCKS);
   if((ip = namei(old)) == 0){
     end_op();
     return -1;
@@ -172,10 +198,11 @@ isdirempty(struct inode *dp)
   int off;
   struct dirent de;
 
-  for(off=2*sizeof(de); off<dp->size; off+=sizeof(de)){
+  // "." and ".." are not necessarily first in a hashed directory.
+  for(off=0; off<dp->size; off+=sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("isdirempty: readi");
-    if(de.inum != 0)
+    if(de.inum != 0 && namecmp(de.name, ".") != 0 && namecmp(de.name, "..") != 0)
       return 0;
   }
   return 1;
@@ -258,7 +285,7 @@ create(char *path, short type, short major, short minor)
     return 0;
   }
 
-  if((ip = ialloc(dp->dev, type)) == 0)
+  if((ip = ialloc(dp->dev, type, dp->inum)) == 0)
     panic("create: ialloc");
 
   ilock(ip);
@@ -275,27 +302,34 @@ create(char *path, short type, short major, short minor)
       panic("create dots");
   }
 
-  if(dirlink(dp, name, ip->inum) < 0)
-    panic("create: dirlink");
+  if(dirlink(dp, name, ip->inum) < 0){
+    // dp is full: undo.
+    if(type == T_DIR){
+      dp->nlink--;
+      iupdate(dp);
+    }
+    ip->nlink = 0;
+    iupdate(ip);
+    iunlockput(ip);
+    iunlockput(dp);
+    return 0;
+  }
 
   iunlockput(dp);
 
   return ip;
 }
 
-uint64
-sys_open(void)
+// Open path in the current process and return
+// the new file descriptor, or -1.
+int
+fileopen(char *path, int omode)
 {
-  char path[MAXPATH];
-  int fd, omode;
+  int fd;
   struct file *f;
   struct inode *ip;
-  int n;
 
-  if((n = argstr(0, path, MAXPATH)) < 0 || argint(1, &omode) < 0)
-    return -1;
-
-  begin_op();
+  begin_opn(omode & O_CREATE ? MAXOPBLOCKS + DIRLINKBLOCKS : MAXOPBLOCKS);
 
   if(omode & O_CREATE){
     ip = create(path, T_FILE, 0, 0);
@@ -340,6 +374,7 @@ sys_open(void)
   f->ip = ip;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->nonblock = (omode & O_NONBLOCK) != 0;
 
   if((omode & O_TRUNC) && ip->type == T_FILE){
     itrunc(ip);
@@ -351,13 +386,24 @@ sys_open(void)
   return fd;
 }
 
+uint64
+sys_open(void)
+{
+  char path[MAXPATH];
+  int omode;
+
+  if(argstr(0, path, MAXPATH) < 0 || argint(1, &omode) < 0)
+    return -1;
+  return fileopen(path, omode);
+}
+
 uint64
 sys_mkdir(void)
 {
   char path[MAXPATH];
   struct inode *ip;
 
-  begin_op();
+  begin_opn(MAXOPBLOCKS + DIRLINKBLOCKS);
   if(argstr(0, path, MAXPATH) < 0 || (ip = create(path, T_DIR, 0, 0)) == 0){
     end_op();
     return -1;
@@ -374,7 +420,7 @@ sys_mknod(void)
   char path[MAXPATH];
   int major, minor;
 
-  begin_op();
+  begin_opn(MAXOPBLOCKS + DIRLINKBLOCKS);
   if((argstr(0, path, MAXPATH)) < 0 ||
      argint(1, &major) < 0 ||
      argint(2, &minor) < 0 ||
@@ -454,18 +500,20 @@ sys_exec(void)
   return -1;
 }
 
-uint64
-sys_pipe(void)
+// Create a pipe and store its read and write descriptors
+// in the user array fdarray. flags may include O_NONBLOCK.
+static int
+makepipe(uint64 fdarray, int flags)
 {
-  uint64 fdarray; // user pointer to array of two integers
   struct file *rf, *wf;
   int fd0, fd1;
   struct proc *p = myproc();
 
-  if(argaddr(0, &fdarray) < 0)
+  if(flags & ~O_NONBLOCK)
     return -1;
   if(pipealloc(&rf, &wf) < 0)
     return -1;
+  rf->nonblock = wf->nonblock = (flags & O_NONBLOCK) != 0;
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
     if(fd0 >= 0)
@@ -484,3 +532,221 @@ sys_pipe(void)
   }
   return 0;
 }
+
+uint64
+sys_pipe(void)
+{
+  uint64 fdarray; // user pointer to array of two integers
+
+  if(argaddr(0, &fdarray) < 0)
+    return -1;
+  return makepipe(fdarray, 0);
+}
+
+uint64
+sys_pipe2(void)
+{
+  uint64 fdarray;
+  int flags;
+
+  if(argaddr(0, &fdarray) < 0 || argint(1, &flags) < 0)
+    return -1;
+  return makepipe(fdarray, flags);
+}
+
+// Move n bytes from fdin to fdout without copying them
+// through user space. Uses and advances fdin's offset.
+uint64
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0)
+    return -1;
+  return filesplice(in, out, 0, n);
+}
+
+// Send n bytes of the file open on fdin to fdout.
+// If off is not null, read from *off and update it,
+// leaving fdin's own offset alone.
+uint64
+sys_sendfile(void)
+{
+  struct file *in, *out;
+  uint64 uoff;
+  uint off;
+  int n, r;
+  struct proc *p = myproc();
+
+  if(argfd(0, 0, &out) < 0 || argfd(1, 0, &in) < 0 ||
+     argaddr(2, &uoff) < 0 || argint(3, &n) < 0)
+    return -1;
+  if(in->type != FD_INODE)
+    return -1;
+  if(uoff == 0)
+    return filesplice(in, out, 0, n);
+
+  if(copyin(p->pagetable, (char*)&off, uoff, sizeof(off)) < 0)
+    return -1;
+  r = filesplice(in, out, &off, n);
+  if(copyout(p->pagetable, uoff, (char*)&off, sizeof(off)) < 0)
+    return -1;
+  return r;
+}
+
+uint64
+sys_poll(void)
+{
+  struct pollfd fds[NOFILE];
+  uint64 ufds; // user pointer to array of struct pollfd
+  int nfds, timeout, r;
+  struct proc *p = myproc();
+
+  if(argaddr(0, &ufds) < 0 || argint(1, &nfds) < 0 || argint(2, &timeout) < 0)
+    return -1;
+  if(nfds < 0 || nfds > NOFILE)
+    return -1;
+  if(copyin(p->pagetable, (char*)fds, ufds, nfds*sizeof(fds[0])) < 0)
+    return -1;
+  if((r = poll(fds, nfds, timeout)) < 0)
+    return -1;
+  if(copyout(p->pagetable, ufds, (char*)fds, nfds*sizeof(fds[0])) < 0)
+    return -1;
+  return r;
+}
+
+// Get or set the flags of an open file.
+// Only O_NONBLOCK can be changed.
+uint64
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg, flags;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &cmd) < 0 || argint(2, &arg) < 0)
+    return -1;
+  switch(cmd){
+  case F_GETFL:
+    if(f->readable && f->writable)
+      flags = O_RDWR;
+    else if(f->writable)
+      flags = O_WRONLY;
+    else
+      flags = O_RDONLY;
+    if(f->nonblock)
+      flags |= O_NONBLOCK;
+    return flags;
+  case F_SETFL:
+    f->nonblock = (arg & O_NONBLOCK) != 0;
+    return 0;
+  }
+  return -1;
+}
+
+// Fetch the nth system call argument as a user array of cnt
+// struct iovec, and copy it into iov. The lengths must add
+// up to no more than an int can count.
+static int
+argiov(int n, int cnt, struct iovec *iov)
+{
+  uint64 uiov, tot;
+  int i;
+
+  if(argaddr(n, &uiov) < 0)
+    return -1;
+  if(cnt < 0 || cnt > MAXIOV)
+    return -1;
+  if(copyin(myproc()->pagetable, (char*)iov, uiov, cnt*sizeof(iov[0])) < 0)
+    return -1;
+  tot = 0;
+  for(i = 0; i < cnt; i++){
+    if(iov[i].len > 0x7fffffff)
+      return -1;
+    tot += iov[i].len;
+  }
+  if(tot > 0x7fffffff)
+    return -1;
+  return 0;
+}
+
+uint64
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[MAXIOV];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &cnt) < 0 || argiov(1, cnt, iov) < 0)
+    return -1;
+  return filereadv(f, iov, cnt);
+}
+
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[MAXIOV];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &cnt) < 0 || argiov(1, cnt, iov) < 0)
+    return -1;
+  return filewritev(f, iov, cnt);
+}
+
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &n) < 0 ||
+     argint(3, &off) < 0)
+    return -1;
+  return filepread(f, p, n, off);
+}
+
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &n) < 0 ||
+     argint(3, &off) < 0)
+    return -1;
+  return filepwrite(f, p, n, off);
+}
+
+uint64
+sys_ring_setup(void)
+{
+  return ringsetup();
+}
+
+uint64
+sys_ring_enter(void)
+{
+  int n;
+
+  if(argint(0, &n) < 0)
+    return -1;
+  return ringenter(n);
+}
+
+uint64
+sys_blkstat(void)
+{
+  uint64 addr;
+  struct blkstat st;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  blk_stat(&st);
+  bstat(&st);
+  if(copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
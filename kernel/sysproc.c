@@ -6,6 +6,7 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "sysctl.h"
 
 uint64
 sys_exit(void)
@@ -95,3 +96,28 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// read and set kernel knobs; see sysctl.h.
+uint64
+sys_sysctl(void)
+{
+  int name, val;
+
+  if(argint(0, &name) < 0 || argint(1, &val) < 0 || val < -1)
+    return -1;
+  switch(name){
+  case CTL_DISKPOLL:
+    return virtio_disk_setpoll(val);
+  case CTL_BCACHEPOLICY:
+    return bsetpolicy(val);
+  case CTL_NBUF:
+    return bsetmax(val);
+  case CTL_DROPCACHE:
+    if(val == 1)
+      bdrop();
+    return 0;
+  case CTL_LAZYCOMMIT:
+    return log_setlazy(val);
+  }
+  return -1;
+}
@@ -166,6 +166,10 @@ clockintr()
   ticks++;
   wakeup(&ticks);
   release(&tickslock);
+  polltick();
+  logtick();
+  if(virtio_disk_polling())
+    virtio_disk_poll();
 }
 
 // check if it's an external interrupt or software interrupt,
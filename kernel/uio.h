@@ -0,0 +1,7 @@
+// Buffer descriptors for readv() and writev().
+// Both the kernel and user programs use this header file.
+
+struct iovec {
+  void *base;  // start of buffer
+  uint len;    // size of buffer in bytes
+};
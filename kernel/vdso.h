@@ -0,0 +1,10 @@
+// Page the kernel maps read-only into every process at VDSO,
+// so that user code can answer getpid() and uptime() without
+// a system call. Nothing in it changes once the process
+// runs; the time comes from the time CSR.
+struct vdso {
+  int pid;             // the process's pid
+  uint64 boottime;     // time CSR value when ticks was 0
+  uint64 tickcycles;   // time CSR cycles per tick
+  uint64 hz;           // time CSR cycles per second
+};
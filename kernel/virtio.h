@@ -43,9 +43,13 @@
 #define VIRTIO_RING_F_INDIRECT_DESC 28
 #define VIRTIO_RING_F_EVENT_IDX     29
 
+// with EVENT_IDX, interrupt after this many completions
+// (or fewer, if fewer requests are outstanding).
+#define COALESCE 4
+
 // this many virtio descriptors.
 // must be a power of two.
-#define NUM 8
+#define NUM 64
 
 // a single descriptor, from the spec.
 struct virtq_desc {
@@ -56,14 +60,16 @@ struct virtq_desc {
 };
 #define VRING_DESC_F_NEXT  1 // chained with another descriptor
 #define VRING_DESC_F_WRITE 2 // device writes (vs read)
+#define VRING_DESC_F_INDIRECT 4 // addr/len is a table of descriptors
 
 // the (entire) avail ring, from the spec.
 struct virtq_avail {
-  uint16 flags; // always zero
+  uint16 flags; // VRING_AVAIL_F_NO_INTERRUPT, or zero
   uint16 idx;   // driver will write ring[idx] next
   uint16 ring[NUM]; // descriptor numbers of chain heads
-  uint16 unused;
+  uint16 used_event; // with EVENT_IDX: interrupt when used idx passes this
 };
+#define VRING_AVAIL_F_NO_INTERRUPT 1 // hint, ignored with EVENT_IDX
 
 // one entry in the "used" ring, with which the
 // device tells the driver about completed requests.
@@ -76,6 +82,7 @@ struct virtq_used {
   uint16 flags; // always zero
   uint16 idx;   // device increments when it adds a ring[] entry
   struct virtq_used_elem ring[NUM];
+  uint16 avail_event; // with EVENT_IDX: notify when avail idx passes this
 };
 
 // these are specific to virtio block devices, e.g. disks,
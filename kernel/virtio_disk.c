@@ -16,6 +16,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "blk.h"
 
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
@@ -61,13 +62,25 @@ static struct disk {
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
   struct {
-    struct buf *b;
+    struct blkreq *r;
     char status;
   } info[NUM];
 
   // disk command headers.
   // one-for-one with descriptors, for convenience.
   struct virtio_blk_req ops[NUM];
+
+  // indirect descriptor tables for multi-block requests,
+  // indexed by the ring descriptor that points to them.
+  int use_indirect; // did the device accept VIRTIO_RING_F_INDIRECT_DESC?
+  struct virtq_desc indirect[NUM][MAXSEG+2];
+
+  int event_idx;    // did the device accept VIRTIO_RING_F_EVENT_IDX?
+  uint16 notified;  // avail->idx when we last considered notifying
+  int inflight;     // requests the device has not completed
+  int poll;         // poll for completions rather than take interrupts
+  uint64 nnotify;   // writes to QUEUE_NOTIFY
+  uint64 nintr;     // interrupts taken
   
   struct spinlock vdisk_lock;
   
@@ -100,9 +113,9 @@ virtio_disk_init(void)
   features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
   features &= ~(1 << VIRTIO_BLK_F_MQ);
   features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
-  features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
-  features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
   *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+  disk.use_indirect = (features & (1 << VIRTIO_RING_F_INDIRECT_DESC)) != 0;
+  disk.event_idx = (features & (1 << VIRTIO_RING_F_EVENT_IDX)) != 0;
 
   // tell device that feature negotiation is complete.
   status |= VIRTIO_CONFIG_S_FEATURES_OK;
@@ -121,6 +134,8 @@ virtio_disk_init(void)
     panic("virtio disk has no queue 0");
   if(max < NUM)
     panic("virtio disk max queue too short");
+  if(NUM*sizeof(struct virtq_desc) + sizeof(struct virtq_avail) > PGSIZE)
+    panic("virtio disk queue too big for pages[]");
   *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
   memset(disk.pages, 0, sizeof(disk.pages));
   *R(VIRTIO_MMIO_QUEUE_PFN) = ((uint64)disk.pages) >> PGSHIFT;
@@ -166,7 +181,6 @@ free_desc(int i)
   disk.desc[i].flags = 0;
   disk.desc[i].next = 0;
   disk.free[i] = 1;
-  wakeup(&disk.free[0]);
 }
 
 // free a chain of descriptors.
@@ -184,12 +198,11 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
+// allocate n descriptors (they need not be contiguous).
 static int
-alloc3_desc(int *idx)
+alloc_descs(int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
+  for(int i = 0; i < n; i++){
     idx[i] = alloc_desc();
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
@@ -200,88 +213,190 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// from the spec: has an index moved from old to new
+// past the event index the other side asked about?
+static int
+need_event(uint16 event, uint16 new, uint16 old)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
+  return (uint16)(new - event - 1) < (uint16)(new - old);
+}
+
+// queue the transfer described by r, whose bufs must be locked,
+// and return without waiting for it to finish; the device hears
+// about it at the next virtio_disk_notify(). virtio_disk_intr()
+// (or virtio_disk_poll()) calls blk_done(r) when it completes.
+// returns -1, having done nothing, if there are not enough free
+// descriptors; the caller should try again after a completion.
+// never sleeps, so it may be called from an interrupt.
+int
+virtio_disk_submit(struct blkreq *r)
+{
+  struct virtq_desc chain[MAXSEG+2];
+  int idx[MAXSEG+2];
+  struct buf *b;
+  int i, n = r->nbuf, head;
+
+  if(n < 1 || n > MAXSEG)
+    panic("virtio_disk_submit");
 
   acquire(&disk.vdisk_lock);
 
   // the spec's Section 5.2 says that legacy block operations use
-  // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
-
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
+  // a descriptor for type/reserved/sector, then the data, then
+  // one for a 1-byte status result. the data may be spread over
+  // several descriptors, one per buf here.
+
+  // a multi-block request goes in an indirect table, if the
+  // device supports them, so that it uses just one ring descriptor.
+  int indirect = disk.use_indirect && n > 1;
+  if(alloc_descs(idx, indirect ? 1 : n + 2) < 0){
+    release(&disk.vdisk_lock);
+    return -1;
   }
+  head = idx[0];
 
-  // format the three descriptors.
+  // format the descriptors.
   // qemu's virtio-blk.c reads them.
 
-  struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
+  struct virtio_blk_req *buf0 = &disk.ops[head];
 
-  if(write)
+  if(r->write)
     buf0->type = VIRTIO_BLK_T_OUT; // write the disk
   else
     buf0->type = VIRTIO_BLK_T_IN; // read the disk
   buf0->reserved = 0;
-  buf0->sector = sector;
+  buf0->sector = r->head->blockno * (BSIZE / 512);
 
-  disk.desc[idx[0]].addr = (uint64) buf0;
-  disk.desc[idx[0]].len = sizeof(struct virtio_blk_req);
-  disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-  disk.desc[idx[0]].next = idx[1];
+  chain[0].addr = (uint64) buf0;
+  chain[0].len = sizeof(struct virtio_blk_req);
+  chain[0].flags = VRING_DESC_F_NEXT;
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
-
-  disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+  for(i = 1, b = r->head; b; i++, b = b->qnext){
+    chain[i].addr = (uint64) b->data;
+    chain[i].len = BSIZE;
+    if(r->write)
+      chain[i].flags = 0; // device reads b->data
+    else
+      chain[i].flags = VRING_DESC_F_WRITE; // device writes b->data
+    chain[i].flags |= VRING_DESC_F_NEXT;
+  }
+  if(i != n+1)
+    panic("virtio_disk_submit: nbuf");
+
+  disk.info[head].status = 0xff; // device writes 0 on success
+  chain[n+1].addr = (uint64) &disk.info[head].status;
+  chain[n+1].len = 1;
+  chain[n+1].flags = VRING_DESC_F_WRITE; // device writes the status
+
+  if(indirect){
+    for(i = 0; i < n+2; i++){
+      disk.indirect[head][i] = chain[i];
+      disk.indirect[head][i].next = i + 1;
+    }
+    disk.indirect[head][n+1].next = 0;
+    disk.desc[head].addr = (uint64) disk.indirect[head];
+    disk.desc[head].len = (n+2) * sizeof(struct virtq_desc);
+    disk.desc[head].flags = VRING_DESC_F_INDIRECT;
+    disk.desc[head].next = 0;
+  } else {
+    for(i = 0; i < n+2; i++){
+      disk.desc[idx[i]] = chain[i];
+      disk.desc[idx[i]].next = (i+1 < n+2) ? idx[i+1] : 0;
+    }
+  }
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  // record the request for virtio_disk_intr().
+  disk.info[head].r = r;
 
   // tell the device the first index in our chain of descriptors.
-  disk.avail->ring[disk.avail->idx % NUM] = idx[0];
+  disk.avail->ring[disk.avail->idx % NUM] = head;
 
   __sync_synchronize();
 
   // tell the device another avail ring entry is available.
   disk.avail->idx += 1; // not % NUM ...
+  disk.inflight++;
 
-  __sync_synchronize();
+  release(&disk.vdisk_lock);
+  return 0;
+}
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+// tell the device about requests submitted since the last call.
+// with EVENT_IDX the device says (in avail_event) when it wants
+// to hear; while it is still working through the ring, it will
+// find the new requests without a notification.
+void
+virtio_disk_notify(void)
+{
+  acquire(&disk.vdisk_lock);
 
-  // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
-  }
+  uint16 idx = disk.avail->idx;
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+  __sync_synchronize();
+
+  if(idx != disk.notified &&
+     (!disk.event_idx || need_event(disk.used->avail_event, idx, disk.notified))){
+    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+    disk.nnotify++;
+  }
+  disk.notified = idx;
 
   release(&disk.vdisk_lock);
 }
 
+// collect the requests the device has completed into done[],
+// and return how many. then tell the device when to interrupt
+// next: after a few more completions, or (while polling) not
+// for the foreseeable future. caller must hold vdisk_lock.
+static int
+reap(struct blkreq **done)
+{
+  int n = 0;
+
+  while(1){
+    // the device increments disk.used->idx when it
+    // adds an entry to the used ring.
+    while(disk.used_idx != disk.used->idx){
+      __sync_synchronize();
+      int id = disk.used->ring[disk.used_idx % NUM].id;
+
+      if(disk.info[id].status != 0)
+        panic("virtio_disk_intr status");
+
+      done[n++] = disk.info[id].r;
+      disk.info[id].r = 0;
+      free_chain(id);
+      disk.inflight--;
+
+      disk.used_idx += 1;
+    }
+
+    if(!disk.event_idx)
+      break;
+    if(disk.poll){
+      disk.avail->used_event = disk.used_idx + 0x7fff;
+    } else {
+      int k = disk.inflight < COALESCE ? disk.inflight : COALESCE;
+      if(k == 0)
+        k = 1;
+      disk.avail->used_event = disk.used_idx + k - 1;
+    }
+    __sync_synchronize();
+
+    // a completion that raced with setting used_event
+    // may not raise an interrupt; pick it up now.
+    if(disk.used_idx == disk.used->idx)
+      break;
+  }
+  return n;
+}
+
 void
 virtio_disk_intr()
 {
+  struct blkreq *done[NUM];
+  int n;
+
   acquire(&disk.vdisk_lock);
 
   // the device won't raise another interrupt until we tell it
@@ -291,25 +406,70 @@ virtio_disk_intr()
   // completion entries in this interrupt, and have nothing to do
   // in the next interrupt, which is harmless.
   *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+  disk.nintr++;
 
   __sync_synchronize();
 
-  // the device increments disk.used->idx when it
-  // adds an entry to the used ring.
+  n = reap(done);
 
-  while(disk.used_idx != disk.used->idx){
-    __sync_synchronize();
-    int id = disk.used->ring[disk.used_idx % NUM].id;
+  release(&disk.vdisk_lock);
+
+  // blk_done() may submit more requests,
+  // so call it without vdisk_lock.
+  for(int i = 0; i < n; i++)
+    blk_done(done[i]);
+}
+
+// check for completed requests without an interrupt.
+// called by waiters in polling mode, and on every clock
+// tick so that nothing is stranded.
+void
+virtio_disk_poll(void)
+{
+  struct blkreq *done[NUM];
+  int n;
 
-    if(disk.info[id].status != 0)
-      panic("virtio_disk_intr status");
+  acquire(&disk.vdisk_lock);
+  n = reap(done);
+  release(&disk.vdisk_lock);
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+  for(int i = 0; i < n; i++)
+    blk_done(done[i]);
+}
 
-    disk.used_idx += 1;
+// are we in polling mode?
+int
+virtio_disk_polling(void)
+{
+  return disk.poll;
+}
+
+// switch polling mode on (1) or off (0), or leave it
+// alone (-1). returns the previous setting.
+int
+virtio_disk_setpoll(int on)
+{
+  int old;
+
+  acquire(&disk.vdisk_lock);
+  old = disk.poll;
+  if(on >= 0){
+    disk.poll = (on != 0);
+    disk.avail->flags = disk.poll ? VRING_AVAIL_F_NO_INTERRUPT : 0;
   }
+  release(&disk.vdisk_lock);
+
+  // re-arm used_event for the new mode.
+  virtio_disk_poll();
+  return old;
+}
 
+// report notification and interrupt counts.
+void
+virtio_disk_stat(uint64 *nnotify, uint64 *nintr)
+{
+  acquire(&disk.vdisk_lock);
+  *nnotify = disk.nnotify;
+  *nintr = disk.nintr;
   release(&disk.vdisk_lock);
 }
@@ -22,7 +22,7 @@
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int nlog = LOGSIZE + 1;  // header and LOGSIZE blocks
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
@@ -31,6 +31,8 @@ struct superblock sb;
 char zeroes[BSIZE];
 uint freeinode = 1;
 uint freeblock;
+struct dirent rootde[NINODES];  // the root directory, written last
+int nrootde;
 
 
 void balloc(int);
@@ -40,6 +42,8 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+void rootlink(char *name, uint inum);
+void dirwrite(uint inum, struct dirent *de, int n);
 
 // convert to intel byte order
 ushort
@@ -68,16 +72,21 @@ int
 main(int argc, char *argv[])
 {
   int i, cc, fd;
-  uint rootino, inum, off;
-  struct dirent de;
+  uint rootino, inum, flags = 0;
   char buf[BSIZE];
-  struct dinode din;
 
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
+  // -o: ordered-data mode, in which only metadata is journaled.
+  if(argc > 1 && strcmp(argv[1], "-o") == 0){
+    flags |= FS_ORDERED;
+    argc--;
+    argv++;
+  }
+
   if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+    fprintf(stderr, "Usage: mkfs [-o] fs.img files...\n");
     exit(1);
   }
 
@@ -102,6 +111,7 @@ main(int argc, char *argv[])
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.flags = xint(flags);
 
   printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
          nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
@@ -118,15 +128,8 @@ main(int argc, char *argv[])
   rootino = ialloc(T_DIR);
   assert(rootino == ROOTINO);
 
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, ".");
-  iappend(rootino, &de, sizeof(de));
-
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, "..");
-  iappend(rootino, &de, sizeof(de));
+  rootlink(".", rootino);
+  rootlink("..", rootino);
 
   for(i = 2; i < argc; i++){
     // get rid of "user/"
@@ -152,10 +155,7 @@ main(int argc, char *argv[])
 
     inum = ialloc(T_FILE);
 
-    bzero(&de, sizeof(de));
-    de.inum = xshort(inum);
-    strncpy(de.name, shortname, DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
+    rootlink(shortname, inum);
 
     while((cc = read(fd, buf, sizeof(buf))) > 0)
       iappend(inum, buf, cc);
@@ -163,12 +163,7 @@ main(int argc, char *argv[])
     close(fd);
   }
 
-  // fix size of root inode dir
-  rinode(rootino, &din);
-  off = xint(din.size);
-  off = ((off/BSIZE) + 1) * BSIZE;
-  din.size = xint(off);
-  winode(rootino, &din);
+  dirwrite(rootino, rootde, nrootde);
 
   balloc(freeblock);
 
@@ -238,6 +233,8 @@ ialloc(ushort type)
   din.type = xshort(type);
   din.nlink = xshort(1);
   din.size = xint(0);
+  if(type == T_FILE)
+    din.flags = xint(DI_INLINE);
   winode(inum, &din);
   return inum;
 }
@@ -260,18 +257,131 @@ balloc(int used)
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+#define DPB (BSIZE / sizeof(struct dirent))  // dirents per block
+
+// Add (name, inum) to the root directory.
+void
+rootlink(char *name, uint inum)
+{
+  struct dirent *de;
+
+  assert(nrootde < NINODES);
+  de = &rootde[nrootde++];
+  bzero(de, sizeof(*de));
+  de->inum = xshort(inum);
+  strncpy(de->name, name, DIRSIZ);
+}
+
+// FNV-1a hash of a directory entry name, as in the kernel.
+uint
+namehash(const char *name)
+{
+  uint h = 2166136261;
+  int i;
+
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = (h ^ (uchar)name[i]) * 16777619;
+  return h;
+}
+
+// Write the n entries de[] to empty directory inum: linearly
+// if they fit in a block, else hashed (see fs.h) with a table
+// just deep enough that no leaf overflows.
+void
+dirwrite(uint inum, struct dirent *de, int n)
+{
+  char idx[DIRIDXBLOCKS*BSIZE];
+  struct dirent leaf[DPB];
+  struct dirhead *hd;
+  struct dirslot *ds;
+  struct dinode din;
+  int count[1 << DIRMAXDEPTH];
+  uint depth, mask, k;
+  int i, j, ok;
+
+  if(n <= DPB){
+    iappend(inum, de, n * sizeof(*de));
+    // fix size of the directory to a whole block
+    rinode(inum, &din);
+    din.size = xint(BSIZE);
+    winode(inum, &din);
+    return;
+  }
+
+  for(depth = 0; ; depth++){
+    assert(depth <= DIRMAXDEPTH);
+    mask = (1 << depth) - 1;
+    memset(count, 0, sizeof(count));
+    ok = 1;
+    for(i = 0; i < n; i++)
+      if(++count[namehash(de[i].name) & mask] > DPB)
+        ok = 0;
+    if(ok)
+      break;
+  }
+
+  bzero(idx, sizeof(idx));
+  hd = (struct dirhead*)idx;
+  hd->depth = xshort(depth);
+  hd->magic = xint(DIRMAGIC);
+  ds = (struct dirslot*)idx;
+  for(k = 0; k <= mask; k++)
+    ds[1 + k/DIRIDXPER].leaf[k%DIRIDXPER] = xshort(DIRIDXBLOCKS + k);
+  iappend(inum, idx, sizeof(idx));
+
+  for(k = 0; k <= mask; k++){
+    bzero(leaf, sizeof(leaf));
+    for(i = j = 0; i < n; i++)
+      if((namehash(de[i].name) & mask) == k)
+        leaf[j++] = de[i];
+    iappend(inum, leaf, sizeof(leaf));
+  }
+}
+
+// Return the block that entry i of indirect block ind names,
+// allocating it if need be.
+uint
+ientry(uint ind, uint i)
+{
+  uint indirect[NINDIRECT];
+
+  rsect(ind, (char*)indirect);
+  if(indirect[i] == 0){
+    indirect[i] = xint(freeblock++);
+    wsect(ind, (char*)indirect);
+  }
+  return xint(indirect[i]);
+}
+
 void
 iappend(uint inum, void *xp, int n)
 {
   char *p = (char*)xp;
-  uint fbn, off, n1;
+  uint fbn, off, n1, bn, span;
   struct dinode din;
   char buf[BSIZE];
-  uint indirect[NINDIRECT];
   uint x;
+  int level;
 
   rinode(inum, &din);
   off = xint(din.size);
+  if(xint(din.flags) & DI_INLINE){
+    if(off + n <= NINLINE){
+      bcopy(p, din.data + off, n);
+      din.size = xint(off + n);
+      winode(inum, &din);
+      return;
+    }
+    // too big to stay inline: move the data to a block,
+    // as the kernel's writei() does.
+    bcopy(din.data, buf, off);
+    bzero(din.data, sizeof(din.data));
+    din.flags = xint(0);
+    din.size = xint(0);
+    winode(inum, &din);
+    iappend(inum, buf, off);
+    rinode(inum, &din);
+  }
   // printf("append inum %d at off %d sz %d\n", inum, off, n);
   while(n > 0){
     fbn = off / BSIZE;
@@ -282,15 +392,21 @@ iappend(uint inum, void *xp, int n)
       }
       x = xint(din.addrs[fbn]);
     } else {
-      if(xint(din.addrs[NDIRECT]) == 0){
-        din.addrs[NDIRECT] = xint(freeblock++);
+      // walk down the indirect tree that maps fbn, as bmap() does.
+      bn = fbn - NDIRECT;
+      span = 1;
+      for(level = 0; bn >= span * NINDIRECT; level++){
+        bn -= span * NINDIRECT;
+        span *= NINDIRECT;
+      }
+      if(xint(din.addrs[NDIRECT+level]) == 0){
+        din.addrs[NDIRECT+level] = xint(freeblock++);
       }
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
+      x = xint(din.addrs[NDIRECT+level]);
+      for(; span > 0; span /= NINDIRECT){
+        x = ientry(x, bn / span);
+        bn %= span;
       }
-      x = xint(indirect[fbn-NDIRECT]);
     }
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
@@ -0,0 +1,135 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "kernel/blkstat.h"
+#include "kernel/sysctl.h"
+#include "user/user.h"
+
+// compare buffer cache hit rates under LRU and 2Q while
+// a big file is read over and over through a small cache,
+// between passes that look up a directory of small files.
+
+#define NSMALL 40   // small files, whose metadata is the hot set
+#define BIG 250     // blocks in the big file, more than NBUFMIN
+#define ROUNDS 10
+
+char buf[BSIZE];
+char name[] = "cbdir/xx";
+
+void
+lookups(void)
+{
+  struct stat st;
+  int i, fd;
+
+  for(i = 0; i < NSMALL; i++){
+    name[6] = '0' + i/10;
+    name[7] = '0' + i%10;
+    if((fd = open(name, O_RDONLY)) < 0 || fstat(fd, &st) < 0){
+      fprintf(2, "cachebench: cannot open %s\n", name);
+      exit(1);
+    }
+    close(fd);
+  }
+}
+
+void
+scan(void)
+{
+  int fd;
+
+  if((fd = open("cbbig", O_RDONLY)) < 0){
+    fprintf(2, "cachebench: cannot open cbbig\n");
+    exit(1);
+  }
+  while(read(fd, buf, sizeof(buf)) > 0)
+    ;
+  close(fd);
+}
+
+int
+percent(uint64 hits, uint64 misses)
+{
+  if(hits + misses == 0)
+    return 100;
+  return hits * 100 / (hits + misses);
+}
+
+void
+run(int policy, char *pname)
+{
+  struct blkstat st0, st1, st2;
+  uint64 lhits, lmisses;
+  int r;
+
+  sysctl(CTL_BCACHEPOLICY, policy);
+  sysctl(CTL_DROPCACHE, 1);
+  lookups();
+  scan();
+  lhits = lmisses = 0;
+  blkstat(&st0);
+  for(r = 0; r < ROUNDS; r++){
+    blkstat(&st1);
+    lookups();
+    blkstat(&st2);
+    lhits += st2.hits - st1.hits;
+    lmisses += st2.misses - st1.misses;
+    scan();
+  }
+  blkstat(&st1);
+  printf("%s: overall %d%% hits (%d/%d), lookups %d%% hits (%d/%d)\n",
+         pname,
+         percent(st1.hits - st0.hits, st1.misses - st0.misses),
+         (int)(st1.hits - st0.hits),
+         (int)(st1.hits - st0.hits + st1.misses - st0.misses),
+         percent(lhits, lmisses), (int)lhits, (int)(lhits + lmisses));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, fd, oldpolicy, oldmax;
+
+  mkdir("cbdir");
+  for(i = 0; i < NSMALL; i++){
+    name[6] = '0' + i/10;
+    name[7] = '0' + i%10;
+    if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+      fprintf(2, "cachebench: cannot create %s\n", name);
+      exit(1);
+    }
+    close(fd);
+  }
+  fd = open("cbbig", O_CREATE|O_RDWR|O_TRUNC);
+  for(i = 0; i < BIG; i++){
+    if(fd < 0 || write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      fprintf(2, "cachebench: cannot create cbbig\n");
+      exit(1);
+    }
+  }
+  close(fd);
+
+  oldpolicy = sysctl(CTL_BCACHEPOLICY, -1);
+  oldmax = sysctl(CTL_NBUF, NBUFMIN);
+  if(oldpolicy < 0 || oldmax < 0){
+    fprintf(2, "cachebench: sysctl failed\n");
+    exit(1);
+  }
+  printf("%d buffers, %d small files, %d block file, %d rounds\n",
+         sysctl(CTL_NBUF, -1), NSMALL, BIG, ROUNDS);
+  run(BCACHE_LRU, "lru");
+  run(BCACHE_2Q, "2q");
+  sysctl(CTL_BCACHEPOLICY, oldpolicy);
+  sysctl(CTL_NBUF, oldmax);
+
+  for(i = 0; i < NSMALL; i++){
+    name[6] = '0' + i/10;
+    name[7] = '0' + i%10;
+    unlink(name);
+  }
+  unlink("cbdir");
+  unlink("cbbig");
+  exit(0);
+}
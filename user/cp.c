@@ -0,0 +1,36 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+// copy with sendfile(), so the data never passes
+// through this process's memory.
+#define CHUNK (64*1024)
+
+int
+main(int argc, char *argv[])
+{
+  int in, out, n;
+
+  if(argc != 3){
+    fprintf(2, "Usage: cp src dst\n");
+    exit(1);
+  }
+  if((in = open(argv[1], O_RDONLY)) < 0){
+    fprintf(2, "cp: cannot open %s\n", argv[1]);
+    exit(1);
+  }
+  if((out = open(argv[2], O_CREATE|O_WRONLY|O_TRUNC)) < 0){
+    fprintf(2, "cp: cannot create %s\n", argv[2]);
+    exit(1);
+  }
+  while((n = sendfile(out, in, 0, CHUNK)) > 0)
+    ;
+  if(n < 0){
+    fprintf(2, "cp: copy to %s failed\n", argv[2]);
+    exit(1);
+  }
+  close(in);
+  close(out);
+  exit(0);
+}
@@ -0,0 +1,56 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/sysctl.h"
+#include "user/user.h"
+
+// time creating, writing and deleting small files with
+// a commit at the end of every FS call, and lazily with
+// one sync() at the end.
+
+#define NFILE 100
+
+char data[100];
+char name[] = "cbxx";
+
+int
+run(int lazy)
+{
+  int i, fd, t0;
+
+  sysctl(CTL_LAZYCOMMIT, lazy);
+  t0 = uptime();
+  for(i = 0; i < NFILE; i++){
+    name[2] = '0' + i/10;
+    name[3] = '0' + i%10;
+    fd = open(name, O_CREATE|O_WRONLY);
+    if(fd < 0 || write(fd, data, sizeof(data)) != sizeof(data)){
+      fprintf(2, "createbench: cannot create %s\n", name);
+      exit(1);
+    }
+    close(fd);
+  }
+  for(i = 0; i < NFILE; i++){
+    name[2] = '0' + i/10;
+    name[3] = '0' + i%10;
+    unlink(name);
+  }
+  sync();
+  return uptime() - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int old, eager, lazy;
+
+  if((old = sysctl(CTL_LAZYCOMMIT, -1)) < 0){
+    fprintf(2, "createbench: sysctl failed\n");
+    exit(1);
+  }
+  eager = run(0);
+  lazy = run(1);
+  sysctl(CTL_LAZYCOMMIT, old);
+  printf("%d small files: eager %d ticks, lazy %d ticks\n", NFILE, eager, lazy);
+  exit(0);
+}
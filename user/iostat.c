@@ -0,0 +1,35 @@
+#include "kernel/types.h"
+#include "kernel/blkstat.h"
+#include "user/user.h"
+
+// print the disk request queue and buffer cache statistics.
+
+int
+main(int argc, char *argv[])
+{
+  struct blkstat st;
+  int i;
+
+  if(blkstat(&st) < 0){
+    fprintf(2, "iostat: blkstat failed\n");
+    exit(1);
+  }
+  printf("reads %d writes %d blocks %d merges %d\n",
+         (int)st.reads, (int)st.writes, (int)st.blocks, (int)st.merges);
+  printf("queued %d inflight %d maxdepth %d\n",
+         st.queued, st.inflight, st.maxdepth);
+  printf("notifies %d interrupts %d\n", (int)st.notifies, (int)st.intrs);
+  printf("bufs %d hits %d misses %d evictions %d grows %d shrinks %d\n",
+         st.nbuf, (int)st.hits, (int)st.misses, (int)st.evictions,
+         (int)st.grows, (int)st.shrinks);
+  printf("latency (us):\n");
+  for(i = 0; i < NBLKHIST; i++){
+    if(st.hist[i] == 0)
+      continue;
+    if(i == NBLKHIST-1)
+      printf("  >= %d: %d\n", 1 << i, (int)st.hist[i]);
+    else
+      printf("  < %d: %d\n", 2 << i, (int)st.hist[i]);
+  }
+  exit(0);
+}
@@ -27,7 +27,9 @@ ls(char *path)
 {
   char buf[512], *p;
   int fd;
+  uint off;
   struct dirent de;
+  struct dirhead hd;
   struct stat st;
 
   if((fd = open(path, 0)) < 0){
@@ -54,7 +56,14 @@ ls(char *path)
     strcpy(buf, path);
     p = buf+strlen(buf);
     *p++ = '/';
-    while(read(fd, &de, sizeof(de)) == sizeof(de)){
+    // a hashed directory's entries start after its index.
+    off = 0;
+    if(pread(fd, &hd, sizeof(hd), 0) == sizeof(hd) &&
+       hd.inum == 0 && hd.magic == DIRMAGIC){
+      printf("%s: hashed, depth %d\n", path, hd.depth);
+      off = DIRIDXBLOCKS * BSIZE;
+    }
+    for(; pread(fd, &de, sizeof(de), off) == sizeof(de); off += sizeof(de)){
       if(de.inum == 0)
         continue;
       memmove(p, de.name, DIRSIZ);
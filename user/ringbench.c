@@ -0,0 +1,91 @@
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/ring.h"
+#include "user/user.h"
+
+// compare one system call per small read against
+// the same reads submitted in batches through the ring.
+
+#define N 8192      // reads per run
+#define SZ 64       // bytes per read
+#define FILESZ 4096
+
+char buf[SZ];
+char data[FILESZ];
+
+int
+bysyscall(int fd)
+{
+  int i;
+
+  for(i = 0; i < N; i++)
+    if(pread(fd, buf, SZ, (i*SZ) % FILESZ) != SZ)
+      return -1;
+  return 0;
+}
+
+int
+byring(struct ring *r, int fd)
+{
+  struct ring_sqe *e;
+  struct ring_cqe *c;
+  int i, queued;
+
+  for(i = 0; i < N; ){
+    for(queued = 0; i < N && (e = ring_get_sqe(r)) != 0; i++, queued++){
+      e->op = RING_READ;
+      e->fd = fd;
+      e->addr = (uint64)buf;
+      e->len = SZ;
+      e->off = (i*SZ) % FILESZ;
+      e->user_data = i;
+    }
+    if(ring_submit(r) != queued)
+      return -1;
+    while((c = ring_peek_cqe(r)) != 0){
+      if(c->res != SZ)
+        return -1;
+      ring_cqe_seen(r);
+    }
+  }
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct ring *r;
+  int fd, t0, t1, t2, i;
+
+  if((r = ring_setup()) == (struct ring*)-1){
+    fprintf(2, "ringbench: ring_setup failed\n");
+    exit(1);
+  }
+
+  for(i = 0; i < FILESZ; i++)
+    data[i] = i;
+  fd = open("ringbench.tmp", O_CREATE|O_RDWR|O_TRUNC);
+  if(fd < 0 || write(fd, data, FILESZ) != FILESZ){
+    fprintf(2, "ringbench: cannot create ringbench.tmp\n");
+    exit(1);
+  }
+
+  t0 = uptime();
+  if(bysyscall(fd) < 0){
+    fprintf(2, "ringbench: pread failed\n");
+    exit(1);
+  }
+  t1 = uptime();
+  if(byring(r, fd) < 0){
+    fprintf(2, "ringbench: ring read failed\n");
+    exit(1);
+  }
+  t2 = uptime();
+
+  printf("%d reads of %d bytes: syscalls %d ticks, ring (batch %d) %d ticks\n",
+         N, SZ, t1 - t0, RINGSIZE, t2 - t1);
+
+  close(fd);
+  unlink("ringbench.tmp");
+  exit(0);
+}
@@ -2,6 +2,9 @@
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
 #include "user/user.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
+#include "kernel/vdso.h"
 
 char*
 strcpy(char *s, const char *t)
@@ -134,3 +137,30 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// getpid() and the clock read the kernel's vdso page
+// instead of making a system call.
+static struct vdso *vdso = (struct vdso*)VDSO;
+
+int
+getpid(void)
+{
+  return vdso->pid;
+}
+
+// clock ticks since boot; the timer interrupts every
+// tickcycles cycles from boottime on, so this is ticks.
+int
+uptime(void)
+{
+  return (r_time() - vdso->boottime) / vdso->tickcycles;
+}
+
+// microseconds since boot, from the time CSR.
+uint64
+uptimeus(void)
+{
+  uint64 t = r_time() - vdso->boottime;
+
+  return (t / vdso->hz) * 1000000 + (t % vdso->hz) * 1000000 / vdso->hz;
+}
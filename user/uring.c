@@ -0,0 +1,48 @@
+#include "kernel/types.h"
+#include "kernel/ring.h"
+#include "user/user.h"
+
+// Helpers for the ring mapped by ring_setup().
+// Typical use: fill entries from ring_get_sqe(), hand them
+// all to the kernel with ring_submit(), then drain
+// ring_peek_cqe()/ring_cqe_seen().
+
+// Return a cleared submission entry, queued to be
+// run by the next ring_submit(), or 0 if the ring is full.
+struct ring_sqe*
+ring_get_sqe(struct ring *r)
+{
+  struct ring_sqe *e;
+
+  if(r->sq_tail - r->sq_head >= RINGSIZE)
+    return 0;
+  e = &r->sq[r->sq_tail % RINGSIZE];
+  memset(e, 0, sizeof(*e));
+  e->off = -1;
+  r->sq_tail++;
+  return e;
+}
+
+// Run every queued entry with one system call.
+// Returns the number the kernel consumed.
+int
+ring_submit(struct ring *r)
+{
+  return ring_enter(r->sq_tail - r->sq_head);
+}
+
+// Return the oldest unconsumed completion, or 0.
+struct ring_cqe*
+ring_peek_cqe(struct ring *r)
+{
+  if(r->cq_head == r->cq_tail)
+    return 0;
+  return &r->cq[r->cq_head % RINGSIZE];
+}
+
+// Release the completion returned by ring_peek_cqe().
+void
+ring_cqe_seen(struct ring *r)
+{
+  r->cq_head++;
+}
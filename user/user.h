@@ -1,5 +1,11 @@
 struct stat;
 struct rtcdate;
+struct pollfd;
+struct iovec;
+struct ring;
+struct blkstat;
+struct ring_sqe;
+struct ring_cqe;
 
 // system calls
 int fork(void);
@@ -19,10 +25,23 @@ int link(const char*, const char*);
 int mkdir(const char*);
 int chdir(const char*);
 int dup(int);
-int getpid(void);
 char* sbrk(int);
 int sleep(int);
-int uptime(void);
+int splice(int, int, int);
+int sendfile(int, int, uint*, int);
+int poll(struct pollfd*, int, int);
+int pipe2(int*, int);
+int fcntl(int, int, int);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int pread(int, void*, int, uint);
+int pwrite(int, const void*, int, uint);
+struct ring* ring_setup(void);
+int ring_enter(int);
+int blkstat(struct blkstat*);
+int sysctl(int, int);
+int fsync(int);
+int sync(void);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -40,3 +59,12 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+int getpid(void);
+int uptime(void);
+uint64 uptimeus(void);
+
+// uring.c
+struct ring_sqe* ring_get_sqe(struct ring*);
+int ring_submit(struct ring*);
+struct ring_cqe* ring_peek_cqe(struct ring*);
+void ring_cqe_seen(struct ring*);
@@ -4,6 +4,12 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/poll.h"
+#include "kernel/errno.h"
+#include "kernel/uio.h"
+#include "kernel/ring.h"
+#include "kernel/blkstat.h"
+#include "kernel/sysctl.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
@@ -569,6 +575,9 @@ writetest(char *s)
   }
 }
 
+// big enough to need the double indirect block.
+#define BIGBLOCKS (NDIRECT + NINDIRECT + 100)
+
 void
 writebig(char *s)
 {
@@ -580,7 +589,7 @@ writebig(char *s)
     exit(1);
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < BIGBLOCKS; i++){
     ((int*)buf)[0] = i;
     if(write(fd, buf, BSIZE) != BSIZE){
       printf("%s: error: write big file failed\n", s, i);
@@ -600,7 +609,7 @@ writebig(char *s)
   for(;;){
     i = read(fd, buf, BSIZE);
     if(i == 0){
-      if(n == MAXFILE - 1){
+      if(n != BIGBLOCKS){
         printf("%s: read only %d blocks from big", s, n);
         exit(1);
       }
@@ -779,6 +788,826 @@ pipe1(char *s)
   }
 }
 
+// large reads and writes that wrap around the pipe's
+// multi-page ring buffer in the middle of a copy.
+void
+pipebig(char *s)
+{
+  int fds[2], pid, xstatus;
+  int i, n, total;
+  enum { N=7, SZ=9001 };
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork() failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(n = 0; n < N; n++){
+      for(i = 0; i < SZ; i++)
+        buf[i] = n*SZ + i;
+      if(write(fds[1], buf, SZ) != SZ){
+        printf("%s: short pipe write\n", s);
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  total = 0;
+  while((n = read(fds[0], buf, sizeof(buf))) > 0){
+    for(i = 0; i < n; i++){
+      if((buf[i] & 0xff) != ((total + i) & 0xff)){
+        printf("%s: wrong byte at %d\n", s, total + i);
+        exit(1);
+      }
+    }
+    total += n;
+  }
+  close(fds[0]);
+  if(total != N * SZ){
+    printf("%s: total %d\n", s, total);
+    exit(1);
+  }
+  wait(&xstatus);
+  exit(xstatus);
+}
+
+
+// move file data through two pipes and back into a file
+// with sendfile() and splice().
+void
+splicetest(char *s)
+{
+  int fd, out, p1[2], p2[2], i, n;
+  uint off;
+  enum { SZ=6000 };
+
+  unlink("splice0");
+  unlink("splice1");
+  fd = open("splice0", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create splice0 failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++)
+    buf[i] = i % 251;
+  if(write(fd, buf, SZ) != SZ){
+    printf("%s: write splice0 failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if(pipe(p1) < 0 || pipe(p2) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  fd = open("splice0", O_RDONLY);
+  out = open("splice1", O_CREATE|O_RDWR);
+  if(fd < 0 || out < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+
+  // explicit offset: must not move fd's own offset.
+  off = 100;
+  if(sendfile(p1[1], fd, &off, 50) != 50 || off != 150){
+    printf("%s: sendfile with offset failed\n", s);
+    exit(1);
+  }
+  if(read(p1[0], buf, 50) != 50 || buf[0] != 100 % 251){
+    printf("%s: sendfile with offset moved wrong data\n", s);
+    exit(1);
+  }
+
+  if(sendfile(p1[1], fd, 0, SZ) != SZ){
+    printf("%s: sendfile failed\n", s);
+    exit(1);
+  }
+  if(splice(p1[0], p2[1], SZ) != SZ){
+    printf("%s: pipe to pipe splice failed\n", s);
+    exit(1);
+  }
+  if(splice(p2[0], out, SZ) != SZ){
+    printf("%s: pipe to file splice failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  close(out);
+  close(p1[0]);
+  close(p1[1]);
+  close(p2[0]);
+  close(p2[1]);
+
+  fd = open("splice1", O_RDONLY);
+  memset(buf, 0, SZ);
+  if((n = read(fd, buf, sizeof(buf))) != SZ){
+    printf("%s: splice1 has %d bytes\n", s, n);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++){
+    if((buf[i] & 0xff) != i % 251){
+      printf("%s: wrong byte at %d\n", s, i);
+      exit(1);
+    }
+  }
+  close(fd);
+  unlink("splice0");
+  unlink("splice1");
+}
+
+// wait for one of two pipes with poll().
+void
+polltest(char *s)
+{
+  int a[2], b[2], pid, xstatus;
+  struct pollfd pfd[3];
+
+  if(pipe(a) < 0 || pipe(b) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+
+  pfd[0].fd = a[0];
+  pfd[0].events = POLLIN;
+  pfd[1].fd = b[0];
+  pfd[1].events = POLLIN;
+  pfd[2].fd = a[1];
+  pfd[2].events = POLLOUT;
+
+  // only the write end is ready.
+  if(poll(pfd, 3, 0) != 1 || pfd[2].revents != POLLOUT){
+    printf("%s: write end not ready\n", s);
+    exit(1);
+  }
+
+  // nothing to read: time out.
+  if(poll(pfd, 2, 2) != 0 || pfd[0].revents || pfd[1].revents){
+    printf("%s: poll did not time out\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    sleep(2);
+    write(b[1], "x", 1);
+    exit(0);
+  }
+  if(poll(pfd, 2, -1) != 1 || pfd[0].revents || pfd[1].revents != POLLIN){
+    printf("%s: poll missed write\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+
+  // the other end of a is closed.
+  close(a[1]);
+  if(poll(pfd, 1, -1) != 1 || (pfd[0].revents & POLLHUP) == 0){
+    printf("%s: poll missed hangup\n", s);
+    exit(1);
+  }
+
+  // an fd that is not open.
+  pfd[0].fd = NOFILE - 1;
+  if(poll(pfd, 1, 0) != 1 || pfd[0].revents != POLLNVAL){
+    printf("%s: bad fd not reported\n", s);
+    exit(1);
+  }
+  exit(xstatus);
+}
+
+// O_NONBLOCK pipes return -EAGAIN instead of sleeping.
+void
+nonblock(char *s)
+{
+  int fds[2], n, total;
+
+  if(pipe2(fds, O_NONBLOCK) < 0){
+    printf("%s: pipe2 failed\n", s);
+    exit(1);
+  }
+  if((fcntl(fds[0], F_GETFL, 0) & O_NONBLOCK) == 0){
+    printf("%s: F_GETFL lost O_NONBLOCK\n", s);
+    exit(1);
+  }
+  if(read(fds[0], buf, 1) != -EAGAIN){
+    printf("%s: read of empty pipe did not fail with EAGAIN\n", s);
+    exit(1);
+  }
+
+  // fill the pipe; the last write is short or fails.
+  total = 0;
+  while((n = write(fds[1], buf, 1000)) == 1000)
+    total += n;
+  if(n != -EAGAIN && n <= 0){
+    printf("%s: write to full pipe returned %d\n", s, n);
+    exit(1);
+  }
+  if(n > 0)
+    total += n;
+  if(write(fds[1], buf, 1) != -EAGAIN){
+    printf("%s: write to full pipe did not fail with EAGAIN\n", s);
+    exit(1);
+  }
+
+  // back to blocking: drain what was written.
+  if(fcntl(fds[0], F_SETFL, 0) < 0 || (fcntl(fds[0], F_GETFL, 0) & O_NONBLOCK)){
+    printf("%s: F_SETFL failed\n", s);
+    exit(1);
+  }
+  while(total > 0){
+    if((n = read(fds[0], buf, sizeof(buf))) <= 0){
+      printf("%s: read returned %d\n", s, n);
+      exit(1);
+    }
+    total -= n;
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// readv/writev gather and scatter; pread/pwrite leave
+// the file offset alone.
+void
+iovtest(char *s)
+{
+  int fd;
+  struct iovec iov[3];
+  char a[4], b[8], c[16];
+
+  unlink("iovfile");
+  fd = open("iovfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  iov[0].base = "aaa";
+  iov[0].len = 3;
+  iov[1].base = "bbbbb";
+  iov[1].len = 5;
+  iov[2].base = "cc";
+  iov[2].len = 2;
+  if(writev(fd, iov, 3) != 10){
+    printf("%s: writev failed\n", s);
+    exit(1);
+  }
+
+  // overwrite "bbbbb" in place; the offset stays at 10.
+  if(pwrite(fd, "BBBBB", 5, 3) != 5){
+    printf("%s: pwrite failed\n", s);
+    exit(1);
+  }
+  if(write(fd, "d", 1) != 1){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  memset(c, 0, sizeof(c));
+  if(pread(fd, c, sizeof(c), 0) != 11 || strcmp(c, "aaaBBBBBccd") != 0){
+    printf("%s: pread got %s\n", s, c);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("iovfile", O_RDONLY);
+  memset(a, 0, sizeof(a));
+  memset(b, 0, sizeof(b));
+  iov[0].base = a;
+  iov[0].len = 3;
+  iov[1].base = b;
+  iov[1].len = sizeof(b);
+  if(readv(fd, iov, 2) != 11 || strcmp(a, "aaa") != 0 ||
+     memcmp(b, "BBBBBccd", 8) != 0){
+    printf("%s: readv failed\n", s);
+    exit(1);
+  }
+  if(pread(fd, c, 1, 20) != 0){
+    printf("%s: pread past end\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("iovfile");
+}
+
+// submit open, write, pwrite and close as one batch through
+// the ring, then check the file and the completions.
+void
+ringtest(char *s)
+{
+  struct ring *r;
+  struct ring_sqe *e;
+  struct ring_cqe *c;
+  char buf[16];
+  int fd, n, res[5];
+
+  r = ring_setup();
+  if(r == (struct ring*)-1 || ring_setup() != r){
+    printf("%s: ring_setup failed\n", s);
+    exit(1);
+  }
+  unlink("ringfile");
+
+  // the open is first in the batch, so it gets the lowest free fd.
+  fd = open("ringfile", O_CREATE|O_RDWR);
+  close(fd);
+  unlink("ringfile");
+
+  e = ring_get_sqe(r);
+  e->op = RING_OPEN;
+  e->addr = (uint64)"ringfile";
+  e->len = O_CREATE|O_RDWR;
+  e->user_data = 0;
+  e = ring_get_sqe(r);
+  e->op = RING_WRITE;
+  e->fd = fd;
+  e->addr = (uint64)"hello ring";
+  e->len = 10;
+  e->user_data = 1;
+  e = ring_get_sqe(r);
+  e->op = RING_WRITE;
+  e->fd = fd;
+  e->addr = (uint64)"R";
+  e->len = 1;
+  e->off = 6;
+  e->user_data = 2;
+  e = ring_get_sqe(r);
+  e->op = RING_NOP;
+  e->user_data = 3;
+  e = ring_get_sqe(r);
+  e->op = RING_CLOSE;
+  e->fd = fd;
+  e->user_data = 4;
+
+  if(ring_submit(r) != 5){
+    printf("%s: ring_submit failed\n", s);
+    exit(1);
+  }
+  for(n = 0; (c = ring_peek_cqe(r)) != 0; n++){
+    if(c->user_data != n){
+      printf("%s: completion out of order\n", s);
+      exit(1);
+    }
+    res[n] = c->res;
+    ring_cqe_seen(r);
+  }
+  if(n != 5 || res[0] != fd || res[1] != 10 || res[2] != 1 ||
+     res[3] != 0 || res[4] != 0){
+    printf("%s: bad completions\n", s);
+    exit(1);
+  }
+
+  // the close went through the ring too.
+  if(close(fd) == 0){
+    printf("%s: fd still open\n", s);
+    exit(1);
+  }
+  fd = open("ringfile", O_RDONLY);
+  memset(buf, 0, sizeof(buf));
+  if(read(fd, buf, sizeof(buf)) != 10 || strcmp(buf, "hello Ring") != 0){
+    printf("%s: file has %s\n", s, buf);
+    exit(1);
+  }
+  close(fd);
+  unlink("ringfile");
+
+  if(ring_submit(r) != 0 || ring_peek_cqe(r) != 0){
+    printf("%s: empty ring not empty\n", s);
+    exit(1);
+  }
+}
+
+// getpid() and uptime() come from the vdso page;
+// check them against fork() and sleep().
+void
+vdsotest(char *s)
+{
+  int fds[2], pid, cpid, t0;
+  uint64 us0, us1;
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    cpid = getpid();
+    write(fds[1], &cpid, sizeof(cpid));
+    exit(0);
+  }
+  if(read(fds[0], &cpid, sizeof(cpid)) != sizeof(cpid) || cpid != pid ||
+     cpid == getpid()){
+    printf("%s: child pid %d, fork returned %d\n", s, cpid, pid);
+    exit(1);
+  }
+  wait(0);
+  close(fds[0]);
+  close(fds[1]);
+
+  t0 = uptime();
+  us0 = uptimeus();
+  sleep(2);
+  us1 = uptimeus();
+  if(uptime() - t0 < 2 || us1 <= us0){
+    printf("%s: clock did not advance\n", s);
+    exit(1);
+  }
+}
+
+// writing a file of consecutive blocks should show up in the
+// disk statistics, with blocks merged into larger requests.
+void
+blkstattest(char *s)
+{
+  struct blkstat st0, st1;
+  uint64 n0, n1;
+  int fd, i;
+  static char buf[BSIZE];
+
+  if(blkstat(&st0) < 0){
+    printf("%s: blkstat failed\n", s);
+    exit(1);
+  }
+  unlink("blkstatfile");
+  fd = open("blkstatfile", O_CREATE|O_WRONLY);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 8; i++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  unlink("blkstatfile");
+  if(blkstat(&st1) < 0){
+    printf("%s: blkstat failed\n", s);
+    exit(1);
+  }
+
+  if(st1.writes <= st0.writes || st1.blocks < st0.blocks + 8){
+    printf("%s: writes not counted\n", s);
+    exit(1);
+  }
+  // the log is written in consecutive blocks, so some
+  // requests must have carried more than one block.
+  if(st1.blocks - st0.blocks <= (st1.reads - st0.reads) + (st1.writes - st0.writes)){
+    printf("%s: no multi-block requests\n", s);
+    exit(1);
+  }
+  n0 = n1 = 0;
+  for(i = 0; i < NBLKHIST; i++){
+    n0 += st0.hist[i];
+    n1 += st1.hist[i];
+  }
+  if(n1 - n0 != (st1.reads - st0.reads) + (st1.writes - st0.writes)){
+    printf("%s: latency histogram does not add up\n", s);
+    exit(1);
+  }
+}
+
+// re-reading a file should hit in the buffer cache, which
+// should grow to hold it and give the memory back when a
+// process needs it.
+void
+bcachetest(char *s)
+{
+  struct blkstat st0, st1, st2;
+  int fd, i, pass, pid, xstatus;
+  static char buf[BSIZE];
+
+  unlink("bcachefile");
+  fd = open("bcachefile", O_CREATE|O_WRONLY);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 64; i++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  for(pass = 0; pass < 2; pass++){
+    if(pass == 1 && blkstat(&st0) < 0){
+      printf("%s: blkstat failed\n", s);
+      exit(1);
+    }
+    fd = open("bcachefile", O_RDONLY);
+    if(fd < 0){
+      printf("%s: open failed\n", s);
+      exit(1);
+    }
+    while((i = read(fd, buf, sizeof(buf))) > 0)
+      ;
+    close(fd);
+  }
+  if(blkstat(&st1) < 0){
+    printf("%s: blkstat failed\n", s);
+    exit(1);
+  }
+  if(st1.hits < st0.hits + 64){
+    printf("%s: second read missed the cache\n", s);
+    exit(1);
+  }
+  if(st1.nbuf < 64 || st1.grows == 0){
+    printf("%s: cache did not grow\n", s);
+    exit(1);
+  }
+
+  // use up all memory.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    while(sbrk(4096) != (char*)-1)
+      ;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(blkstat(&st2) < 0){
+    printf("%s: blkstat failed\n", s);
+    exit(1);
+  }
+  unlink("bcachefile");
+  if(st2.shrinks == st1.shrinks || st2.nbuf >= st1.nbuf){
+    printf("%s: cache did not shrink\n", s);
+    exit(1);
+  }
+}
+
+// the buffer cache's policy and size can be changed,
+// and it shrinks at once to a smaller size.
+void
+bcachectl(char *s)
+{
+  struct blkstat st;
+  int oldpolicy, oldmax;
+
+  oldpolicy = sysctl(CTL_BCACHEPOLICY, BCACHE_LRU);
+  if(oldpolicy != BCACHE_2Q || sysctl(CTL_BCACHEPOLICY, -1) != BCACHE_LRU){
+    printf("%s: policy sysctl failed\n", s);
+    exit(1);
+  }
+  if(sysctl(CTL_BCACHEPOLICY, 99) != -1){
+    printf("%s: bad policy accepted\n", s);
+    exit(1);
+  }
+  oldmax = sysctl(CTL_NBUF, NBUFMIN);
+  if(oldmax < NBUFMIN || sysctl(CTL_NBUF, -1) != NBUFMIN){
+    printf("%s: nbuf sysctl failed\n", s);
+    exit(1);
+  }
+  if(blkstat(&st) < 0 || st.nbuf > NBUFMIN){
+    printf("%s: cache did not shrink\n", s);
+    exit(1);
+  }
+  sysctl(CTL_NBUF, oldmax);
+  sysctl(CTL_BCACHEPOLICY, oldpolicy);
+}
+
+// reading a file sequentially a block at a time should
+// read ahead, fetching several blocks per disk request.
+void
+readaheadtest(char *s)
+{
+  struct blkstat st0, st1;
+  int fd, i;
+  static char buf[BSIZE];
+
+  unlink("rafile");
+  fd = open("rafile", O_CREATE|O_WRONLY);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 100; i++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  // drop the file from the cache.
+  if(sysctl(CTL_DROPCACHE, 1) < 0){
+    printf("%s: sysctl failed\n", s);
+    exit(1);
+  }
+
+  if(blkstat(&st0) < 0){
+    printf("%s: blkstat failed\n", s);
+    exit(1);
+  }
+  fd = open("rafile", O_RDONLY);
+  if(fd < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 100; i++){
+    if(read(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: read failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  if(blkstat(&st1) < 0){
+    printf("%s: blkstat failed\n", s);
+    exit(1);
+  }
+  unlink("rafile");
+  if(st1.reads - st0.reads >= 50){
+    printf("%s: %d disk reads for 100 blocks\n", s, (int)(st1.reads - st0.reads));
+    exit(1);
+  }
+}
+
+// small files keep their data in the inode until they
+// grow past NINLINE bytes.
+void
+inlinefile(char *s)
+{
+  struct stat st;
+  int fd, i;
+  static char buf[500], rbuf[500];
+
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = 'a' + i % 26;
+  unlink("inl");
+  fd = open("inl", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, buf, 20) != 20 || fstat(fd, &st) < 0){
+    printf("%s: create inl failed\n", s);
+    exit(1);
+  }
+  if(st.size != 20 || st.blocks != 0){
+    printf("%s: 20-byte file: size %d, %d blocks\n", s, (int)st.size, st.blocks);
+    exit(1);
+  }
+
+  // grow past NINLINE, in two writes.
+  if(write(fd, buf + 20, NINLINE - 20) != NINLINE - 20 ||
+     write(fd, buf + NINLINE, sizeof(buf) - NINLINE) != sizeof(buf) - NINLINE ||
+     fstat(fd, &st) < 0){
+    printf("%s: write inl failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(st.size != sizeof(buf) || st.blocks != 1){
+    printf("%s: grown file: size %d, %d blocks\n", s, (int)st.size, st.blocks);
+    exit(1);
+  }
+  fd = open("inl", O_RDONLY);
+  if(fd < 0 || read(fd, rbuf, sizeof(rbuf)) != sizeof(rbuf) ||
+     memcmp(buf, rbuf, sizeof(buf)) != 0){
+    printf("%s: grown file reads back wrong\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // truncated, it is inline again.
+  fd = open("inl", O_RDWR|O_TRUNC);
+  if(fd < 0 || write(fd, "xyz", 3) != 3 || fstat(fd, &st) < 0 ||
+     st.size != 3 || st.blocks != 0){
+    printf("%s: truncated file not inline\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("inl", O_RDONLY);
+  if(fd < 0 || read(fd, rbuf, sizeof(rbuf)) != 3 || memcmp(rbuf, "xyz", 3) != 0){
+    printf("%s: truncated file reads back wrong\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("inl");
+}
+
+// in lazy mode, FS calls should not commit on their own,
+// and sync() and fsync() should.
+void
+lazycommit(char *s)
+{
+  struct blkstat st0, st1, st2;
+  int fd, i, old, fds[2];
+  char name[] = "lcxx";
+
+  if((old = sysctl(CTL_LAZYCOMMIT, 1)) < 0){
+    printf("%s: sysctl failed\n", s);
+    exit(1);
+  }
+  sync();
+  blkstat(&st0);
+  for(i = 0; i < 20; i++){
+    name[2] = '0' + i/10;
+    name[3] = '0' + i%10;
+    if((fd = open(name, O_CREATE|O_WRONLY)) < 0){
+      printf("%s: create failed\n", s);
+      exit(1);
+    }
+    close(fd);
+  }
+  blkstat(&st1);
+  if(sync() < 0){
+    printf("%s: sync failed\n", s);
+    exit(1);
+  }
+  blkstat(&st2);
+  if(st1.writes - st0.writes >= 20){
+    printf("%s: %d disk writes for 20 lazy creates\n", s, (int)(st1.writes - st0.writes));
+    exit(1);
+  }
+  if(st2.writes == st1.writes){
+    printf("%s: sync did not write\n", s);
+    exit(1);
+  }
+
+  fd = open("lc00", O_WRONLY);
+  if(fd < 0 || write(fd, "x", 1) != 1 || fsync(fd) != 0){
+    printf("%s: fsync failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(fsync(fd) != -1){
+    printf("%s: fsync of closed fd succeeded\n", s);
+    exit(1);
+  }
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(fsync(fds[0]) != -1){
+    printf("%s: fsync of a pipe succeeded\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  for(i = 0; i < 20; i++){
+    name[2] = '0' + i/10;
+    name[3] = '0' + i%10;
+    unlink(name);
+  }
+  if(sysctl(CTL_LAZYCOMMIT, old) != 1 || sysctl(CTL_LAZYCOMMIT, 2) != -1){
+    printf("%s: sysctl CTL_LAZYCOMMIT wrong\n", s);
+    exit(1);
+  }
+}
+
+// in polling mode disk I/O should complete without
+// any disk interrupts.
+void
+diskpoll(char *s)
+{
+  struct blkstat st0, st1;
+  int fd, i, old;
+  static char buf[BSIZE];
+
+  old = sysctl(CTL_DISKPOLL, 1);
+  if(old < 0 || sysctl(CTL_DISKPOLL, -1) != 1){
+    printf("%s: sysctl failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 2; i++){
+    // the first round lets any interrupt already
+    // on its way arrive before we take st0.
+    if(i == 1)
+      blkstat(&st0);
+    unlink("diskpollfile");
+    fd = open("diskpollfile", O_CREATE|O_WRONLY);
+    if(fd < 0 || write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+    close(fd);
+  }
+  blkstat(&st1);
+  unlink("diskpollfile");
+  sysctl(CTL_DISKPOLL, old);
+
+  if(st1.writes == st0.writes){
+    printf("%s: no disk writes\n", s);
+    exit(1);
+  }
+  if(st1.intrs != st0.intrs){
+    printf("%s: %d disk interrupts while polling\n", s, (int)(st1.intrs - st0.intrs));
+    exit(1);
+  }
+}
 
 // test if child is killed (status = -1)
 void
@@ -1553,6 +2382,71 @@ bigdir(char *s)
   }
 }
 
+// a directory big enough to be hashed, which must look
+// like any other to read(), unlink() and rmdir.
+void
+hashdir(char *s)
+{
+  enum { N = 1000 };
+  int i, fd, n;
+  char name[16];
+  struct dirent de;
+
+  if(mkdir("hd") != 0){
+    printf("%s: mkdir hd failed\n", s);
+    exit(1);
+  }
+  fd = open("hd/f", O_CREATE);
+  if(fd < 0){
+    printf("%s: create hd/f failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  strcpy(name, "hd/xxxx");
+  for(i = 0; i < N; i++){
+    name[3] = '0' + i / 1000;
+    name[4] = '0' + (i / 100) % 10;
+    name[5] = '0' + (i / 10) % 10;
+    name[6] = '0' + i % 10;
+    if(link("hd/f", name) != 0){
+      printf("%s: link hd/f %s failed\n", s, name);
+      exit(1);
+    }
+  }
+
+  // every name once, plus f, ".", and "..".
+  fd = open("hd", O_RDONLY);
+  n = 0;
+  while(read(fd, &de, sizeof(de)) == sizeof(de))
+    if(de.inum != 0)
+      n++;
+  close(fd);
+  if(n != N + 3){
+    printf("%s: read %d entries, not %d\n", s, n, N + 3);
+    exit(1);
+  }
+
+  if(unlink("hd") == 0 || link("hd/f", "hd/0500") == 0){
+    printf("%s: unlink of full dir or duplicate link succeeded\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    name[3] = '0' + i / 1000;
+    name[4] = '0' + (i / 100) % 10;
+    name[5] = '0' + (i / 10) % 10;
+    name[6] = '0' + i % 10;
+    if(unlink(name) != 0){
+      printf("%s: unlink %s failed\n", s, name);
+      exit(1);
+    }
+  }
+  if(open("hd/0999", O_RDONLY) >= 0 || unlink("hd/f") != 0 ||
+     unlink("hd") != 0){
+    printf("%s: removing hd failed\n", s);
+    exit(1);
+  }
+}
+
 void
 subdir(char *s)
 {
@@ -2816,6 +3710,20 @@ main(int argc, char *argv[])
     {iputtest, "iput"},
     {mem, "mem"},
     {pipe1, "pipe1"},
+    {pipebig, "pipebig"},
+    {splicetest, "splicetest"},
+    {polltest, "polltest"},
+    {nonblock, "nonblock"},
+    {iovtest, "iovtest"},
+    {ringtest, "ringtest"},
+    {vdsotest, "vdsotest"},
+    {blkstattest, "blkstattest"},
+    {bcachetest, "bcachetest"},
+    {bcachectl, "bcachectl"},
+    {readaheadtest, "readaheadtest"},
+    {lazycommit, "lazycommit"},
+    {inlinefile, "inlinefile"},
+    {diskpoll, "diskpoll"},
     {killstatus, "killstatus"},
     {preempt, "preempt"},
     {exitwait, "exitwait"},
@@ -2826,6 +3734,7 @@ main(int argc, char *argv[])
     {iref, "iref"},
     {forktest, "forktest"},
     {bigdir, "bigdir"}, // slow
+    {hashdir, "hashdir"},
     { 0, 0},
   };
 
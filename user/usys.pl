@@ -32,7 +32,20 @@ entry("link");
 entry("mkdir");
 entry("chdir");
 entry("dup");
-entry("getpid");
 entry("sbrk");
 entry("sleep");
-entry("uptime");
+entry("splice");
+entry("sendfile");
+entry("poll");
+entry("pipe2");
+entry("fcntl");
+entry("readv");
+entry("writev");
+entry("pread");
+entry("pwrite");
+entry("ring_setup");
+entry("ring_enter");
+entry("blkstat");
+entry("sysctl");
+entry("fsync");
+entry("sync");